@@ -0,0 +1,69 @@
+// Copyright © 2022 Giorgio Audrito and Lorenzo Testa. All Rights Reserved.
+
+/**
+ * @file allocation_counter.hpp
+ * @brief Counting of the heap allocations performed by each thread.
+ *
+ * The header replaces the global allocation functions, hence it has to be included by
+ * a single translation unit of a program (as the simulation executables do).
+ */
+
+#ifndef FCPP_ALLOCATION_COUNTER_H_
+#define FCPP_ALLOCATION_COUNTER_H_
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+
+/**
+ * @brief Namespace containing all the objects in the FCPP library.
+ */
+namespace fcpp {
+
+//! @brief Namespace for allocation counting.
+namespace allocation {
+
+//! @brief The number of heap allocations performed by the current thread so far.
+inline size_t& count() {
+    thread_local size_t c = 0;
+    return c;
+}
+
+}
+
+}
+
+//! @brief Counted replacement of the global allocation function.
+void* operator new(std::size_t size) {
+    ++fcpp::allocation::count();
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+//! @brief Counted replacement of the global array allocation function.
+void* operator new[](std::size_t size) {
+    return ::operator new(size);
+}
+
+//! @brief Deallocation function matching the replaced allocation function.
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+//! @brief Array deallocation function matching the replaced allocation function.
+void operator delete[](void* p) noexcept {
+    std::free(p);
+}
+
+//! @brief Sized deallocation function matching the replaced allocation function.
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+//! @brief Sized array deallocation function matching the replaced allocation function.
+void operator delete[](void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+#endif // FCPP_ALLOCATION_COUNTER_H_
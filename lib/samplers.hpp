@@ -0,0 +1,157 @@
+// Copyright © 2022 Giorgio Audrito and Lorenzo Testa. All Rights Reserved.
+
+/**
+ * @file samplers.hpp
+ * @brief Samplers of discrete distributions: static ones through alias tables, dynamic ones through Fenwick trees.
+ *
+ * Samplers do not own a random generator: they map uniform values drawn by the caller
+ * (e.g. through `node.next_real` or `node.next_int`) into samples.
+ */
+
+#ifndef FCPP_SAMPLERS_H_
+#define FCPP_SAMPLERS_H_
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "lib/fcpp.hpp"
+
+
+/**
+ * @brief Namespace containing all the objects in the FCPP library.
+ */
+namespace fcpp {
+
+//! @brief Namespace for samplers of discrete distributions.
+namespace samplers {
+
+/**
+ * @brief Sampler of a fixed discrete distribution in constant time (Vose's alias method).
+ *
+ * Every index owns a bucket of equal probability, which is split between the index itself
+ * and an alias index. The table is built in linear time from the weights of the indices.
+ */
+class alias_table {
+  public:
+    //! @brief Default constructor (empty distribution).
+    alias_table() = default;
+
+    //! @brief Constructor given non-negative weights (not all zero).
+    alias_table(std::vector<real_t> const& weights) : m_prob(weights.size()), m_alias(weights.size()) {
+        size_t n = weights.size();
+        real_t total = 0;
+        for (real_t w : weights) total += w;
+        std::vector<real_t> scaled(n);
+        std::vector<size_t> small, large;
+        for (size_t i = 0; i < n; ++i) {
+            scaled[i] = weights[i] * n / total;
+            (scaled[i] < 1 ? small : large).push_back(i);
+        }
+        while (not small.empty() and not large.empty()) {
+            size_t s = small.back(), l = large.back();
+            small.pop_back();
+            m_prob[s] = scaled[s];
+            m_alias[s] = l;
+            scaled[l] -= 1 - scaled[s];
+            if (scaled[l] < 1) {
+                large.pop_back();
+                small.push_back(l);
+            }
+        }
+        // remaining buckets are full (up to rounding errors)
+        for (size_t i : small) m_prob[i] = 1, m_alias[i] = i;
+        for (size_t i : large) m_prob[i] = 1, m_alias[i] = i;
+    }
+
+    //! @brief Number of indices.
+    size_t size() const {
+        return m_prob.size();
+    }
+
+    //! @brief Maps a uniform value in [0,1) to an index.
+    size_t sample(real_t u) const {
+        real_t x = u * m_prob.size();
+        size_t i = std::min(size_t(x), m_prob.size() - 1);
+        return x - i < m_prob[i] ? i : m_alias[i];
+    }
+
+  private:
+    //! @brief Probability of every bucket to yield its own index.
+    std::vector<real_t> m_prob;
+
+    //! @brief Alternative index of every bucket.
+    std::vector<size_t> m_alias;
+};
+
+//! @brief Alias table of a Zipf distribution over `n` indices with a given exponent (index `i` with weight `1/(i+1)^s`).
+inline alias_table zipf_table(size_t n, real_t s = 1) {
+    std::vector<real_t> weights(n);
+    for (size_t i = 0; i < n; ++i) weights[i] = std::pow(real_t(i + 1), -s);
+    return alias_table(weights);
+}
+
+/**
+ * @brief Sampler of a distribution given by non-negative integer counts, updated in logarithmic time (Fenwick tree).
+ *
+ * Every index is sampled with probability proportional to its count.
+ */
+class fenwick_sampler {
+  public:
+    //! @brief Constructor given the number of indices (with zero counts).
+    fenwick_sampler(size_t n = 0) : m_tree(n + 1, 0), m_count(n, 0) {
+        for (m_top = 1; m_top * 2 <= n; m_top *= 2);
+    }
+
+    //! @brief Number of indices.
+    size_t size() const {
+        return m_count.size();
+    }
+
+    //! @brief The count of an index.
+    int64_t count(size_t i) const {
+        return m_count[i];
+    }
+
+    //! @brief The sum of all counts.
+    int64_t total() const {
+        return m_total;
+    }
+
+    //! @brief Adds a (possibly negative) amount to the count of an index.
+    void add(size_t i, int64_t delta) {
+        m_count[i] += delta;
+        m_total += delta;
+        for (++i; i < m_tree.size(); i += i & -i) m_tree[i] += delta;
+    }
+
+    //! @brief Maps a uniform value in [0,total) to an index (with `r` falling within its count).
+    size_t sample(int64_t r) const {
+        size_t i = 0;
+        for (size_t step = m_top; step > 0; step /= 2)
+            if (i + step < m_tree.size() and m_tree[i + step] <= r) {
+                i += step;
+                r -= m_tree[i];
+            }
+        return i;
+    }
+
+  private:
+    //! @brief Partial sums of counts (1-based).
+    std::vector<int64_t> m_tree;
+
+    //! @brief Counts of the indices.
+    std::vector<int64_t> m_count;
+
+    //! @brief Largest power of two not exceeding the number of indices.
+    size_t m_top;
+
+    //! @brief The sum of all counts.
+    int64_t m_total = 0;
+};
+
+} // namespace samplers
+
+} // namespace fcpp
+
+#endif // FCPP_SAMPLERS_H_
@@ -19,6 +19,28 @@
 #define LOG_TYPE_HANDLE_PALLET 2
 #define LOG_TYPE_COLLISION_RISK_START 3
 #define LOG_TYPE_COLLISION_RISK_END 4
+#define LOG_TYPE_NUM 5
+
+//! @brief Counter logs have content type LOG_TYPE_COUNTER plus the type of the logs they count.
+#define LOG_TYPE_COUNTER 128
+
+//! @brief Length of the time buckets of counter logs (tenths of seconds, at most 256).
+#define LOG_AGGREGATION_BUCKET 100
+
+//! @brief Maximum number of goods locations remembered by a wearable.
+#define GOODS_CACHE_CAPACITY 8
+
+//! @brief Maximum hop distance from a wearable of a search towards a cached pallet.
+#define GOODS_CACHE_HOPS 8
+
+//! @brief Number of buckets of delay histograms (of 0.4s each, covering the 25.6s range of log times).
+#define DELAY_HISTOGRAM_BUCKETS 64
+
+//! @brief Maximum number of goods types in an order (queried concurrently by a wearable).
+#define ORDER_MAX_GOODS 4
+
+//! @brief Duration (s) of the reservation of a pallet for a querying wearable, unless renewed.
+#define RESERVATION_LEASE 10
 
 #if FCPP_ENVIRONMENT == FCPP_ENVIRONMENT_PHYSICAL
     #define MSG_SIZE_HARDWARE_LIMIT 222
@@ -26,6 +48,12 @@
     #define MSG_SIZE_HARDWARE_LIMIT 222 + 20 // extra space needed for simulation
 #endif
 
+//! @brief Capacity reserved up-front for the per-round buffers of new logs.
+#define ROUND_LOG_CAPACITY 8
+
+//! @brief Maximum number of logs carried by a device in the safety lane.
+#define SAFETY_LANE_CAPACITY 4
+
 // [INTRODUCTION]
 
 //! @brief Enumeration of device types.
@@ -66,10 +94,26 @@ namespace coordination {
         struct global_clock {};
         //! @brief Whether the device is a Wearable or a Pallet.
         struct node_type {};
+        //! @brief Whether the device is a sink for log collection.
+        struct log_sink {};
+        //! @brief The redundancy group of a log sink (assigned among the actual sinks by the deployment).
+        struct sink_group {};
         //! @brief Whether a pallet is currently being handled by a wearable.
         struct pallet_handled {};
+        //! @brief The wearable holding a reservation on a pallet.
+        struct reserved_by {};
+        //! @brief The time when the reservation of a pallet expires.
+        struct reservation_end {};
         //! @brief A query for a good, if any.
         struct querying {};
+        //! @brief The goods types currently queried together by a wearable.
+        struct order {};
+        //! @brief The nearest pallet found for every goods type in the order of a wearable.
+        struct order_pallets {};
+        //! @brief The known locations of goods (on wearables).
+        struct goods_cache {};
+        //! @brief The logs passing through a wearable in the previous round (already seen by its goods cache).
+        struct goods_cache_logs {};
         //! @brief The goods currently contained in a pallet.
         struct loaded_goods {};
         //! @brief The goods that a wearable is trying to load on a pallet.
@@ -78,8 +122,14 @@ namespace coordination {
         struct new_logs {};
         //! @brief The logs being collected by the device.
         struct coll_logs {};
+        //! @brief The safety-critical logs newly generated by the device.
+        struct new_safety_logs {};
+        //! @brief The safety-critical logs being collected by the device.
+        struct coll_safety_logs {};
         //! @brief Whether the led is currently on.
         struct led_on {};
+        //! @brief Number of wearables routed through or standing near the device.
+        struct congestion {};
         //! @brief Message size of the last message sent.
         struct msg_size {};
         //! @brief Whether the last message was sent.
@@ -90,6 +140,8 @@ namespace coordination {
         struct log_collected {};
         //! @brief The delays of received logs.
         struct logging_delay {};
+        //! @brief The delays of received safety-critical logs.
+        struct safety_delay {};
     }
 }
 
@@ -106,14 +158,116 @@ using pallet_content_type = common::tagged_tuple_t<coordination::tags::goods_typ
 //! @brief Type for logs.
 using log_type = common::tagged_tuple_t<coordination::tags::log_content_type, uint8_t, coordination::tags::logger_id, device_t, coordination::tags::log_time, uint8_t, coordination::tags::log_content, uint16_t>;
 
+//! @brief Whether logs of each type are aggregated into counter logs on the devices creating them (indexed by log type).
+constexpr bool log_aggregated[LOG_TYPE_NUM] = {
+    false,  // unused
+    false,  // LOG_TYPE_PALLET_CONTENT_CHANGE
+    false,  // LOG_TYPE_HANDLE_PALLET
+    false,  // LOG_TYPE_COLLISION_RISK_START
+    false   // LOG_TYPE_COLLISION_RISK_END
+};
+static_assert(not log_aggregated[LOG_TYPE_COLLISION_RISK_START] and not log_aggregated[LOG_TYPE_COLLISION_RISK_END], "collision-risk logs travel in the safety lane and cannot be aggregated");
+
+//! @brief Type for the per-type log counters of a time bucket.
+using log_counters_type = std::array<uint16_t, LOG_TYPE_NUM>;
+
 //! @brief Type for queries.
 using query_type = common::tagged_tuple_t<coordination::tags::goods_type, uint8_t>;
 
+//! @brief Type for orders (sorted goods types, no order if empty).
+using order_type = std::vector<uint8_t>;
+
+//! @brief Type for the per-type distances of an order.
+using order_dist_type = std::array<real_t, ORDER_MAX_GOODS>;
+
+//! @brief Type for the per-type devices of an order.
+using order_dev_type = std::array<device_t, ORDER_MAX_GOODS>;
+
+//! @brief Type for the goods location cache (pairs of goods and pallet UID, most recent first).
+using goods_cache_type = std::vector<tuple<uint8_t, device_t>>;
+
+//! @brief No device.
+constexpr device_t no_device = std::numeric_limits<device_t>::max();
+
+//! @brief Fixed-size histogram of log delays (with tenth of secs precision).
+class delay_histogram {
+  public:
+    //! @brief Type of the bucket counters.
+    using count_type = uint16_t;
+
+    //! @brief Removes all delays.
+    void clear() {
+        m_count.fill(0);
+        m_size = m_sum = 0;
+    }
+
+    //! @brief Adds a delay (in tenths of seconds).
+    void insert(uint8_t d) {
+        ++m_count[d * DELAY_HISTOGRAM_BUCKETS / 256];
+        ++m_size;
+        m_sum += d;
+    }
+
+    //! @brief Number of delays in a bucket.
+    count_type bucket(size_t i) const {
+        return m_count[i];
+    }
+
+    //! @brief Number of delays.
+    size_t size() const {
+        return m_size;
+    }
+
+    //! @brief Sum of delays (in tenths of seconds).
+    uint32_t sum() const {
+        return m_sum;
+    }
+
+  private:
+    //! @brief Number of delays by bucket.
+    std::array<count_type, DELAY_HISTOGRAM_BUCKETS> m_count{};
+
+    //! @brief Number of delays.
+    uint32_t m_size = 0;
+
+    //! @brief Sum of delays.
+    uint32_t m_sum = 0;
+};
+
+//! @brief Printing delay histograms (as number of delays and mean delay).
+template <typename O>
+O& operator<<(O& o, delay_histogram const& h) {
+    return o << h.size() << "@" << (h.size() ? h.sum() * 0.1 / h.size() : 0.0);
+}
+
 //! @brief Converts a floating-point time to a byte value (tenth of secs precision).
 uint8_t discretizer(times_t t) {
     return int(10*t) % 256;
 }
 
+//! @brief Inserts a log into a sorted vector of logs in place (skipping duplicates).
+void insert_log(std::vector<log_type>& v, log_type const& l) {
+    auto it = std::lower_bound(v.begin(), v.end(), l);
+    if (it == v.end() or *it != l) v.insert(it, l);
+}
+
+//! @brief Drops the oldest logs from a sorted vector of logs until at most `cap` are left.
+void cap_logs(std::vector<log_type>& v, size_t cap, uint8_t now) {
+    while (v.size() > cap) {
+        size_t oldest = 0;
+        for (size_t i=1; i<v.size(); ++i)
+            if (uint8_t(now - get<coordination::tags::log_time>(v[i])) > uint8_t(now - get<coordination::tags::log_time>(v[oldest])))
+                oldest = i;
+        v.erase(v.begin() + oldest);
+    }
+}
+
+//! @brief Reserves a minimum capacity for a per-round buffer.
+template <typename T>
+void reserve_round_buffer(std::vector<T>& v, size_t n) {
+    if (v.capacity() < n) v.reserve(n);
+}
+
 }
 
 namespace std {
@@ -123,6 +277,7 @@ std::vector<fcpp::log_type> operator+(std::vector<fcpp::log_type> const& x, std:
     if (y.size() == 0) return x;
     if (x.size() == 0) return y;
     std::vector<fcpp::log_type> z;
+    z.reserve(x.size() + y.size());
     size_t i = 0, j = 0;
     while (i < x.size() and j < y.size()) {
         if (x[i] <= y[j]) {
@@ -149,9 +304,19 @@ std::vector<fcpp::log_type> operator-(std::vector<fcpp::log_type> x, std::vector
 
 //! @brief Tuple hasher.
 template <>
-struct hash<fcpp::tuple<fcpp::device_t,fcpp::query_type>> {
-    size_t operator()(fcpp::tuple<fcpp::device_t,fcpp::query_type> const& k) const {
-        return get<fcpp::coordination::tags::goods_type>(get<1>(k)) | (get<0>(k) << 8);
+struct hash<fcpp::tuple<fcpp::device_t,fcpp::query_type,fcpp::device_t>> {
+    size_t operator()(fcpp::tuple<fcpp::device_t,fcpp::query_type,fcpp::device_t> const& k) const {
+        return (get<fcpp::coordination::tags::goods_type>(get<1>(k)) | (get<0>(k) << 8)) ^ (size_t(get<2>(k)) << 24);
+    }
+};
+
+//! @brief Order key hasher.
+template <>
+struct hash<fcpp::tuple<fcpp::device_t,fcpp::order_type>> {
+    size_t operator()(fcpp::tuple<fcpp::device_t,fcpp::order_type> const& k) const {
+        size_t h = get<0>(k);
+        for (uint8_t g : get<1>(k)) h = h * 31 + g;
+        return h;
     }
 };
 
@@ -162,31 +327,133 @@ namespace fcpp {
 //! @brief Namespace containing the libraries of coordination routines.
 namespace coordination {
 
+/**
+ * @brief Minimum of `d + w` over the neighbours in the domain of `d`, together with the neighbour attaining it.
+ *
+ * The current device `uid` counts with value `self_val`, and ties are broken by smaller device.
+ * Equivalent to `min_hood(CALL, make_tuple(mod_self(CALL, d + w, self_val), node.nbr_uid()))`,
+ * computed in a single merge over the sorted neighbour arrays without temporary fields.
+ */
+inline tuple<real_t, device_t> min_plus_hood(device_t uid, field<real_t> const& d, field<real_t> const& w, real_t self_val) {
+    auto const& ids = details::get_ids(d);
+    auto const& vals = details::get_vals(d);
+    auto const& wids = details::get_ids(w);
+    auto const& wvals = details::get_vals(w);
+    real_t best = self_val;
+    device_t arg = uid;
+    for (size_t i = 0, j = 0; i < ids.size(); ++i) {
+        while (j < wids.size() and wids[j] < ids[i]) ++j;
+        if (ids[i] == uid) continue;
+        real_t v = vals[i+1] + (j < wids.size() and wids[j] == ids[i] ? wvals[j+1] : wvals[0]);
+        if (v < best or (v == best and ids[i] < arg)) {
+            best = v;
+            arg = ids[i];
+        }
+    }
+    return make_tuple(best, arg);
+}
+
+//! @brief Filter state of every neighbour, sorted by device: distance, its rate of change and number of consecutive rejected measures.
+using nbr_filter_type = std::vector<tuple<device_t, real_t, real_t, uint8_t>>;
+
 // [AGGREGATE PROGRAM]
 
-FUN device_t nearest_pallet_device(ARGS) { CODE
-    field<uint8_t> nbr_pallet = nbr(CALL, uint8_t{node.storage(tags::node_type{}) == warehouse_device_type::Pallet});
-    return get<1>(min_hood(CALL, make_tuple(mux(nbr_pallet, node.nbr_dist(), INF), node.nbr_uid())));
+/**
+ * @brief Neighbour distances tracked by an alpha-beta filter (a steady-state Kalman filter with a rate state).
+ *
+ * The distance of every neighbour is predicted from its rate of change, and corrected by a fraction
+ * `alpha` of the innovation (the rate by a fraction `alpha^2 / (2 - alpha)` of it per second).
+ * Measures are rejected as outliers if their innovation exceeds what neighbours moving at a relative
+ * speed of at most `max_speed`, ranged with errors of at most `max_error`, can produce. A second
+ * rejection in a row resets the neighbour to its measured distance, so that motion is never capped.
+ * New neighbours start from their measured distance.
+ */
+FUN field<real_t> filtered_nbr_dist(ARGS, real_t alpha, real_t max_speed, real_t max_error) { CODE
+    real_t dt = node.current_time() - node.previous_time();
+    real_t beta = alpha * alpha / (2 - alpha);
+    real_t gate = 2 * (max_speed * dt + max_error);
+    return old(CALL, nbr_filter_type{}, [&](nbr_filter_type const& prev){
+        // filtered distance, rate and rejections of every neighbour
+        field<tuple<real_t, real_t, uint8_t>> f = map_hood([&](device_t id, real_t d){
+            auto it = std::lower_bound(prev.begin(), prev.end(), id, [](tuple<device_t, real_t, real_t, uint8_t> const& e, device_t i){
+                return get<0>(e) < i;
+            });
+            if (it == prev.end() or get<0>(*it) != id or not isfinite(d) or not (dt > 0))
+                return make_tuple(d, real_t(0), uint8_t(0));
+            real_t p = get<1>(*it) + get<2>(*it) * dt;
+            real_t r = d - p;
+            if (std::abs(r) > gate)
+                return get<3>(*it) == 0 ? make_tuple(p, get<2>(*it), uint8_t(1)) : make_tuple(d, real_t(0), uint8_t(0));
+            real_t rate = max(-max_speed, min(get<2>(*it) + beta * r / dt, max_speed));
+            return make_tuple(p + alpha * r, rate, uint8_t(0));
+        }, node.nbr_uid(), node.nbr_dist());
+        auto const& ids = details::get_ids(f);
+        auto const& vals = details::get_vals(f);
+        nbr_filter_type next;
+        next.reserve(ids.size());
+        for (size_t i = 0; i < ids.size(); ++i)
+            next.emplace_back(ids[i], get<0>(vals[i+1]), get<1>(vals[i+1]), get<2>(vals[i+1]));
+        return make_tuple(map_hood([](tuple<real_t, real_t, uint8_t> const& t){
+            return get<0>(t);
+        }, f), next);
+    });
+}
+//! @brief Export list for filtered_nbr_dist.
+FUN_EXPORT filtered_nbr_dist_t = export_list<nbr_filter_type>;
+
+
+//! @brief The closest pallet according to given neighbour distances.
+FUN device_t nearest_pallet_device(ARGS, field<real_t> const& dist) { CODE
+    bool is_pallet = node.storage(tags::node_type{}) == warehouse_device_type::Pallet;
+    field<uint8_t> nbr_pallet = nbr(CALL, uint8_t{is_pallet});
+    return get<1>(min_plus_hood(node.uid, mux(nbr_pallet, real_t(0), INF), dist, is_pallet ? 0 : INF));
+}
+//! @brief The closest pallet.
+FUN device_t nearest_pallet_device(ARGS) {
+    return nearest_pallet_device(node, call_point, node.nbr_dist());
 }
 //! @brief Export list for nearest_pallet_device.
 FUN_EXPORT nearest_pallet_device_t = export_list<uint8_t>;
 
 
-//! @brief Computes the distance of every neighbour from a source, and the best waypoint towards it (distorting the nbr_dist metric).
-FUN tuple<field<real_t>, device_t> distance_waypoint(ARGS, bool source, real_t distortion) { CODE
+/**
+ * @brief Computes the distance of every neighbour from a source, and the best waypoint towards it.
+ *
+ * The `metric` of neighbour distances is distorted by a constant `distortion` per hop, and by
+ * a `penalty` for crossing the current device (e.g. proportional to its congestion).
+ */
+FUN tuple<field<real_t>, device_t> distance_waypoint(ARGS, field<real_t> const& metric, bool source, real_t distortion, real_t penalty = 0) { CODE
     return nbr(CALL, INF, [&] (field<real_t> d) {
         real_t dist;
-        dist = min_hood(CALL, d + node.nbr_dist(), source ? -distortion : INF);
-        dist += distortion;
+        dist = get<0>(min_plus_hood(node.uid, d, metric, source ? -distortion : INF));
+        dist += distortion + penalty;
+        device_t waypoint = get<1>(min_plus_hood(node.uid, d, field<real_t>(0), dist));
         mod_self(CALL, d) = dist;
-        device_t waypoint = get<1>(min_hood(CALL, make_tuple(d, node.nbr_uid())));
         return make_tuple(make_tuple(d, waypoint), dist);
     });
 }
+//! @brief Computes the distance of every neighbour from a source, and the best waypoint towards it (distorting the nbr_dist metric).
+FUN tuple<field<real_t>, device_t> distance_waypoint(ARGS, bool source, real_t distortion, real_t penalty = 0) {
+    return distance_waypoint(node, call_point, node.nbr_dist(), source, distortion, penalty);
+}
 //! @brief Export list for distance_waypoint.
 FUN_EXPORT distance_waypoint_t = export_list<real_t>;
 
 
+//! @brief Computes the hop-count distance of every neighbour from a source.
+FUN field<uint8_t> hop_gradient(ARGS, bool source) { CODE
+    constexpr uint8_t inf = std::numeric_limits<uint8_t>::max();
+    return nbr(CALL, inf, [&](field<uint8_t> d){
+        uint8_t nd = min_hood(CALL, d, inf);
+        nd = source ? 0 : nd < inf ? nd + 1 : inf;
+        mod_self(CALL, d) = nd;
+        return make_tuple(std::move(d), nd);
+    });
+}
+//! @brief Export list for hop_gradient.
+FUN_EXPORT hop_gradient_t = export_list<uint8_t>;
+
+
 //! @brief Null content.
 constexpr pallet_content_type null_content{UNDEFINED_GOODS};
 
@@ -203,8 +470,8 @@ inline void load_content(pallet_content_type& c, pallet_content_type const& l) {
     c = l;
 }
 
-//! @brief Turns loading_goods on wearables into loaded_goods for the closest pallet.
-FUN std::vector<log_type> load_goods_on_pallet(ARGS, times_t current_clock) { CODE
+//! @brief Turns loading_goods on wearables into loaded_goods for the closest pallet (appending to a sorted vector of logs).
+FUN void load_goods_on_pallet(ARGS, field<real_t> const& dist, times_t current_clock, std::vector<log_type>& logs) { CODE
     // currently loaded good (pallet) and good to be loaded (wearable)
     pallet_content_type& loading = node.storage(tags::loading_goods{});
     pallet_content_type& loaded  = node.storage(tags::loaded_goods{});
@@ -213,34 +480,30 @@ FUN std::vector<log_type> load_goods_on_pallet(ARGS, times_t current_clock) { CO
     // the loading or loaded good of a neighbor
     field<uint8_t> nbr_good = nbr(CALL, get<0>(is_loading ? loading : loaded));
     // the nearest pallet device for loading neighbors
-    device_t nearest = nearest_pallet_device(CALL);
+    device_t nearest = nearest_pallet_device(CALL, dist);
     field<real_t> nbr_nearest = nbr(CALL, is_loading ? constant(CALL, (real_t)nearest) : (real_t)node.uid);
-    // the loading logs vector
-    std::vector<log_type> loading_logs;
     // a loading wearable with a matching nearest good is reset
     if (is_loading and details::self(nbr_good, nearest) == get<0>(loading)) {
         loading = null_content;
-        loading_logs.emplace_back(LOG_TYPE_HANDLE_PALLET, node.uid, discretizer(current_clock), nearest);
+        insert_log(logs, log_type(LOG_TYPE_HANDLE_PALLET, node.uid, discretizer(current_clock), nearest));
     }
     // loading good if nearest for a neighbor (breaking ties by highest good type)
     auto t = max_hood(CALL, fcpp::make_tuple(nbr_nearest == node.uid, nbr_good), fcpp::make_tuple(false, get<0>(no_content)));
     if (get<0>(t) and get<0>(loaded) != get<1>(t)) {
         node.storage(tags::pallet_handled{}) = true;
         load_content(loaded, get<1>(t));
-        loading_logs.emplace_back(LOG_TYPE_PALLET_CONTENT_CHANGE, node.uid, discretizer(current_clock), log_content(get<1>(t)));
+        insert_log(logs, log_type(LOG_TYPE_PALLET_CONTENT_CHANGE, node.uid, discretizer(current_clock), log_content(get<1>(t))));
     }
-    // return loading logs
-    return loading_logs;
 }
 //! @brief Export list for load_goods_on_pallet.
 FUN_EXPORT load_goods_on_pallet_t = export_list<nearest_pallet_device_t, constant_t<real_t>, real_t, uint8_t>;
 
 
-//! @brief Detects potential collision risks.
-FUN std::vector<log_type> collision_detection(ARGS, real_t radius, real_t threshold, times_t current_clock, real_t comm) { CODE
+//! @brief Detects potential collision risks (appending to a sorted vector of logs).
+FUN void collision_detection(ARGS, field<real_t> const& metric, real_t radius, real_t threshold, times_t current_clock, real_t comm, std::vector<log_type>& logs) { CODE
     bool wearable = node.storage(tags::node_type{}) == warehouse_device_type::Wearable;
     std::unordered_map<device_t, real_t> logmap = spawn(CALL, [&](device_t source){
-        auto t = distance_waypoint(CALL, node.uid == source, 0.1*comm);
+        auto t = distance_waypoint(CALL, metric, node.uid == source, 0.1*comm);
         real_t dist = self(CALL, get<0>(t));
         real_t closest_wearable = nbr(CALL, INF, [&](field<real_t> x){
             return min_hood(CALL, mux(get<0>(t) > dist, x, INF), wearable and node.uid != source ? dist : INF);
@@ -250,53 +513,115 @@ FUN std::vector<log_type> collision_detection(ARGS, real_t radius, real_t thresh
             v = (old(CALL, closest_wearable) - closest_wearable) / (node.current_time() - node.previous_time());
         return make_tuple(dist < radius ? v : -INF, dist < radius);
     }, wearable ? common::option<device_t>{node.uid} : common::option<device_t>{});
-    std::vector<log_type> logvec;
-    real_t vn = max(logmap[node.uid], real_t(0));
+    auto it = logmap.find(node.uid);
+    real_t vn = max(it == logmap.end() ? real_t(0) : it->second, real_t(0));
     real_t vo = old(CALL, vn);
     if (vn > threshold and vo <= threshold)
-        logvec.emplace_back(LOG_TYPE_COLLISION_RISK_START, node.uid, discretizer(current_clock), vn);
+        insert_log(logs, log_type(LOG_TYPE_COLLISION_RISK_START, node.uid, discretizer(current_clock), vn));
     if (vo > threshold and vn <= threshold)
-        logvec.emplace_back(LOG_TYPE_COLLISION_RISK_END, node.uid, discretizer(current_clock), vn);
-    return logvec;
+        insert_log(logs, log_type(LOG_TYPE_COLLISION_RISK_END, node.uid, discretizer(current_clock), vn));
 }
 //! @brief Export list for collision_detection.
 FUN_EXPORT collision_detection_t = export_list<spawn_t<device_t, bool>, distance_waypoint_t, real_t>;
 
+/**
+ * @brief Detects potential collision risks from one-hop distances between wearables (appending to a sorted vector of logs).
+ *
+ * Closing speeds are derived from the variation of neighbour distances between rounds, and a risk
+ * is raised when the time to collision with a wearable within `radius` falls below the time needed
+ * to cross `radius` at speed `threshold`. Pallets do not take part in this computation.
+ */
+FUN void local_collision_detection(ARGS, real_t radius, real_t threshold, times_t current_clock, std::vector<log_type>& logs) { CODE
+    if (node.storage(tags::node_type{}) != warehouse_device_type::Wearable) return;
+    // wearable neighbours are the ones exchanging their UID here
+    field<device_t> nbr_wearable = nbr(CALL, node.uid);
+    field<real_t> dist = node.nbr_dist();
+    field<real_t> prev_dist = old(CALL, dist);
+    real_t dt = node.current_time() - node.previous_time();
+    // time to collision and closing speed of the most critical wearable
+    tuple<real_t, real_t> t = fold_hood(CALL, [&](tuple<device_t, device_t, real_t, real_t> n, tuple<real_t, real_t> r){
+        real_t d = get<2>(n);
+        real_t v = (get<3>(n) - d) / dt;
+        if (get<0>(n) != get<1>(n) or d >= radius or not isfinite(v) or v <= 0) return r;
+        tuple<real_t, real_t> c = make_tuple(d / v, v);
+        return c < r ? c : r;
+    }, make_tuple(nbr_wearable, node.nbr_uid(), dist, prev_dist), make_tuple(INF, real_t(0)));
+    bool risk = get<0>(t) * threshold < radius;
+    bool old_risk = old(CALL, risk);
+    if (risk and not old_risk)
+        insert_log(logs, log_type(LOG_TYPE_COLLISION_RISK_START, node.uid, discretizer(current_clock), get<1>(t)));
+    if (old_risk and not risk)
+        insert_log(logs, log_type(LOG_TYPE_COLLISION_RISK_END, node.uid, discretizer(current_clock), get<1>(t)));
+}
+//! @brief Export list for local_collision_detection.
+FUN_EXPORT local_collision_detection_t = export_list<device_t, field<real_t>, bool>;
+
+
+/**
+ * @brief Whether a slot adjacent to a pallet is free, given the numbers of neighbour pallets at squared distances of 1, 2 and 3 grid steps.
+ *
+ * Racks are one or two slots deep, at least two slots long and two levels high, with slots spaced
+ * by a grid step along every axis (levels included). In a full rack, a pallet with `nx` slots beside it
+ * across the rack, `ny` along it and `nz` above or below it has `nx+ny+nz`, `nx*ny+nx*nz+ny*nz` and
+ * `nx*ny*nz` neighbours at those distances. A free slot only removes a neighbour at its own distance:
+ * an adjacent slot is free if the first count is below the one of every rack shape compatible with
+ * the other two counts.
+ */
+constexpr bool free_adjacent_slot(int d1, int d2, int d3) {
+    int expected = 5;
+    for (int nx = 0; nx <= 1; ++nx)
+        for (int ny = 1; ny <= 2; ++ny)
+            for (int nz = 1; nz <= 2; ++nz)
+                if (d2 <= nx*ny + nx*nz + ny*nz and d3 <= nx*ny*nz)
+                    expected = std::min(expected, nx + ny + nz);
+    return d1 < expected;
+}
+// pallets in full racks (two or one slots deep, within racks, at their ends or levels, or at corners)
+static_assert(not free_adjacent_slot(5, 8, 4) and not free_adjacent_slot(4, 5, 2) and not free_adjacent_slot(3, 3, 1), "false free slot in a full rack");
+static_assert(not free_adjacent_slot(4, 4, 0) and not free_adjacent_slot(3, 2, 0) and not free_adjacent_slot(2, 1, 0), "false free slot in a full rack");
+// pallets next to a single free slot in a full rack (two or one slots deep, within racks, at their ends or levels, or at corners)
+static_assert(free_adjacent_slot(4, 8, 4) and free_adjacent_slot(3, 5, 2) and free_adjacent_slot(2, 3, 1), "missed free slot in a full rack");
+static_assert(free_adjacent_slot(3, 4, 0) and free_adjacent_slot(2, 2, 0) and free_adjacent_slot(1, 1, 0), "missed free slot in a full rack");
 
-//! @brief Combinatorics over neighbor distances to find whether there is a nearby space (unused).
-FUN bool smart_nearby_space(ARGS, bool is_pallet, real_t grid_step) { CODE
-    field<bool> nbr_pallet = nbr(CALL, is_pallet);
+//! @brief Whether a pallet is next to a free slot, from the distances of its neighbour pallets (see free_adjacent_slot).
+FUN bool smart_nearby_space(ARGS, field<real_t> const& metric, bool is_pallet, real_t grid_step) { CODE
+    field<uint8_t> nbr_pallet = nbr(CALL, uint8_t{is_pallet});
     if (not is_pallet) return false;
-    field<int> ndi = round(node.nbr_dist() * node.nbr_dist() / (grid_step * grid_step)) * nbr_pallet;
-    int dc[6] = {0,0,0,0,0,0};
-    for (int i=1; i<6; ++i)
-        dc[i] = sum_hood(CALL, field<int>(ndi == i));
-    dc[0] = dc[1] + dc[5];
-    dc[3] = dc[2] + dc[4];
-    dc[4] += dc[1];
-    dc[5] += dc[2];
-    constexpr int lc[6] = {3, 2, 1, 2, 3, 2};
-    for (int i=0; i<6; ++i) if (dc[i] < lc[i])
-        return true;
-    return false;
+    // number of neighbour pallets by squared distance in grid steps
+    std::array<int, 4> dc = fold_hood(CALL, [&](tuple<real_t, uint8_t> t, std::array<int, 4> c){
+        int i = std::round(get<0>(t) * get<0>(t) / (grid_step * grid_step));
+        if (get<1>(t) and 0 < i and i < 4) ++c[i];
+        return c;
+    }, make_tuple(metric, nbr_pallet), std::array<int, 4>{});
+    return free_adjacent_slot(dc[1], dc[2], dc[3]);
 }
 //! @brief Export list for smart_nearby_space.
-FUN_EXPORT smart_nearby_space_t = export_list<bool>;
+FUN_EXPORT smart_nearby_space_t = export_list<uint8_t>;
 
-//! @brief Searches the direction towards the closest space.
-FUN device_t find_space(ARGS, real_t grid_step, real_t comm) { CODE
+/**
+ * @brief Searches the direction towards the closest space.
+ *
+ * With `local_space`, sources are the pallets detecting a free adjacent slot in their rack (levels included)
+ * from the distances of their neighbour pallets; otherwise, the pallets with less than two adjacent pallets.
+ */
+FUN device_t find_space(ARGS, field<real_t> const& metric, real_t grid_step, real_t comm, real_t congestion_weight, bool local_space) { CODE
     bool is_pallet = node.storage(tags::node_type{}) == warehouse_device_type::Pallet and
         node.storage(tags::loaded_goods{}) != no_content and
         node.storage(tags::pallet_handled{}) == false;
-    int pallet_count = fold_hood(CALL, [&](tuple<real_t, uint8_t> t, int c){
-        return c + (get<0>(t) < 1.2 * grid_step and get<1>(t));
-    }, make_tuple(node.nbr_dist(), nbr(CALL, uint8_t{is_pallet})), 0);
-    bool source = is_pallet and pallet_count < 2;
-    auto t = distance_waypoint(CALL, source, 0.1*comm);
+    bool source;
+    if (local_space) {
+        source = smart_nearby_space(CALL, metric, is_pallet, grid_step);
+    } else {
+        int pallet_count = fold_hood(CALL, [&](tuple<real_t, uint8_t> t, int c){
+            return c + (get<0>(t) < 1.2 * grid_step and get<1>(t));
+        }, make_tuple(metric, nbr(CALL, uint8_t{is_pallet})), 0);
+        source = is_pallet and pallet_count < 2;
+    }
+    auto t = distance_waypoint(CALL, metric, source, 0.1*comm, congestion_weight * node.storage(tags::congestion{}));
     return get<1>(t);
 }
 //! @brief Export list for find_space.
-FUN_EXPORT find_space_t = export_list<distance_waypoint_t, uint8_t>;
+FUN_EXPORT find_space_t = export_list<smart_nearby_space_t, distance_waypoint_t, uint8_t>;
 
 //! @brief No query.
 constexpr query_type no_query{NO_GOODS};
@@ -306,19 +631,193 @@ inline bool match(query_type const& q, pallet_content_type const& c) {
     return get<tags::goods_type>(q) == get<tags::goods_type>(c);
 }
 
-//! @brief Searches the direction towards the closest pallet with a good matching the query.
-FUN device_t find_goods(ARGS, query_type query, real_t comm) { CODE
-    using key_type = tuple<device_t,query_type>;
-    std::unordered_map<key_type, device_t> resmap = spawn(CALL, [&](key_type const& key){
-        bool found = match(get<1>(key), node.storage(tags::loaded_goods{})) and node.storage(tags::pallet_handled{}) == false;
-        auto t = distance_waypoint(CALL, found, 0.1*comm);
+//! @brief Forgets the goods cached for a pallet.
+inline void cache_erase(goods_cache_type& cache, device_t pallet) {
+    cache.erase(std::remove_if(cache.begin(), cache.end(), [&](tuple<uint8_t, device_t> const& e){
+        return get<1>(e) == pallet;
+    }), cache.end());
+}
+
+//! @brief Records the goods contained in a pallet.
+inline void cache_insert(goods_cache_type& cache, uint8_t goods, device_t pallet) {
+    cache_erase(cache, pallet);
+    if (goods == NO_GOODS or goods == UNDEFINED_GOODS) return;
+    cache.emplace(cache.begin(), goods, pallet);
+    if (cache.size() > GOODS_CACHE_CAPACITY) cache.pop_back();
+}
+
+//! @brief The most recently cached pallet with given goods (or no_device).
+inline device_t cache_lookup(goods_cache_type const& cache, uint8_t goods) {
+    for (auto const& e : cache) if (get<0>(e) == goods) return get<1>(e);
+    return no_device;
+}
+
+//! @brief Updates the goods location cache of wearables from the logs newly passing through them (a sorted vector).
+FUN void update_goods_cache(ARGS, std::vector<log_type> const& logs) { CODE
+    if (node.storage(tags::node_type{}) != warehouse_device_type::Wearable) return;
+    std::vector<log_type>& seen = node.storage(tags::goods_cache_logs{});
+    goods_cache_type& cache = node.storage(tags::goods_cache{});
+    // skipping logs already passing through in the previous round (merging the sorted vectors)
+    for (size_t i = 0, j = 0; i < logs.size(); ++i) {
+        while (j < seen.size() and seen[j] < logs[i]) ++j;
+        if (j < seen.size() and seen[j] == logs[i]) continue;
+        if (get<tags::log_content_type>(logs[i]) == LOG_TYPE_PALLET_CONTENT_CHANGE)
+            cache_insert(cache, get<tags::log_content>(logs[i]), get<tags::logger_id>(logs[i]));
+        if (get<tags::log_content_type>(logs[i]) == LOG_TYPE_HANDLE_PALLET)
+            cache_erase(cache, get<tags::log_content>(logs[i]));
+    }
+    // copy assignment reuses the capacity of the buffer
+    seen = logs;
+}
+//! @brief Export list for update_goods_cache.
+FUN_EXPORT update_goods_cache_t = export_list<>;
+
+/**
+ * @brief Searches the direction towards the closest pallet with a good matching the query.
+ *
+ * If the goods are in the cache of the querying wearable, the search is first directed
+ * towards the cached pallet and limited to GOODS_CACHE_HOPS hops from the wearable.
+ * If the pallet cannot be reached, it is evicted from the cache and the search falls back
+ * to a network-wide spawn.
+ *
+ * The pallet reached by the gradient is tracked along waypoints and claimed back through the
+ * hop-count tree of the wearable. The claimed pallet grants a lease of RESERVATION_LEASE
+ * seconds to the wearable, renewed while the search is active, and it is excluded from
+ * the searches of other wearables while the lease holds.
+ */
+FUN device_t find_goods(ARGS, field<real_t> const& metric, query_type query, real_t comm, real_t congestion_weight) { CODE
+    using key_type = tuple<device_t,query_type,device_t>;
+    goods_cache_type& cache = node.storage(tags::goods_cache{});
+    device_t target = query == no_query ? no_device : cache_lookup(cache, get<tags::goods_type>(query));
+    std::unordered_map<key_type, tuple<device_t, bool>> resmap = spawn(CALL, [&](key_type const& key){
+        bool local = get<2>(key) != no_device;
+        bool reserved = node.current_time() < node.storage(tags::reservation_end{}) and node.storage(tags::reserved_by{}) != get<0>(key);
+        bool found = match(get<1>(key), node.storage(tags::loaded_goods{})) and node.storage(tags::pallet_handled{}) == false and not reserved and (not local or get<2>(key) == node.uid);
+        auto t = distance_waypoint(CALL, metric, found, 0.1*comm, congestion_weight * node.storage(tags::congestion{}));
         device_t waypoint = get<1>(t);
-        return make_tuple(waypoint, get<0>(key) != node.uid ? status::internal : query == no_query ? status::terminated : status::internal_output);
-    }, query == no_query ? common::option<key_type>{} : common::option<key_type>{node.uid,query});
-    return resmap.empty() ? node.uid : resmap.begin()->second;
+        field<uint8_t> hops = hop_gradient(CALL, get<0>(key) == node.uid);
+        // the pallet reached following the waypoints
+        device_t pallet = nbr(CALL, no_device, [&](field<device_t> p){
+            device_t r = found ? node.uid : waypoint == node.uid ? no_device : details::self(p, waypoint);
+            return make_tuple(r, r);
+        });
+        // the pallet claimed by the wearable, following the hop-count tree backwards
+        device_t claim = nbr(CALL, no_device, [&](field<device_t> c){
+            device_t r = get<0>(key) == node.uid ? pallet : get<1>(min_hood(CALL, make_tuple(hops, c), make_tuple(uint8_t{255}, no_device)));
+            return make_tuple(r, r);
+        });
+        if (found and claim == node.uid) {
+            node.storage(tags::reserved_by{}) = get<0>(key);
+            node.storage(tags::reservation_end{}) = node.current_time() + RESERVATION_LEASE;
+        }
+        status s = status::internal;
+        bool miss = false;
+        if (local) {
+            if (self(CALL, hops) > GOODS_CACHE_HOPS)
+                s = status::border;
+            miss = counter(CALL) > 2*GOODS_CACHE_HOPS and not isfinite(self(CALL, get<0>(t)));
+        }
+        bool current = get<1>(key) == query and get<2>(key) == target;
+        return make_tuple(make_tuple(waypoint, miss), get<0>(key) != node.uid ? s : current ? status::internal_output : status::terminated);
+    }, query == no_query ? common::option<key_type>{} : common::option<key_type>{node.uid,query,target});
+    device_t waypoint = node.uid;
+    for (auto const& r : resmap) {
+        waypoint = get<0>(r.second);
+        if (get<1>(r.second)) cache_erase(cache, target);
+    }
+    return waypoint;
 }
 //! @brief Export list for find_goods.
-FUN_EXPORT find_goods_t = export_list<spawn_t<tuple<device_t,query_type>, status>, distance_waypoint_t>;
+FUN_EXPORT find_goods_t = export_list<spawn_t<tuple<device_t,query_type,device_t>, status>, distance_waypoint_t, hop_gradient_t, device_t, counter_t<>>;
+
+/**
+ * @brief Searches the direction towards the closest pallet matching any goods type of an order.
+ *
+ * A single process carries the whole order (up to ORDER_MAX_GOODS types), with a combined
+ * gradient exchanging the distance and nearest pallet of every type at once. The nearest
+ * pallet of every type is reported in the `order_pallets` storage of the wearable.
+ * The nearest pallet among all types is claimed back through the hop-count tree of the wearable,
+ * and grants it a lease of RESERVATION_LEASE seconds as in find_goods: pallets reserved by other
+ * wearables are not considered.
+ */
+FUN device_t find_order(ARGS, field<real_t> const& metric, order_type const& order, real_t comm, real_t congestion_weight) { CODE
+    using key_type = tuple<device_t,order_type>;
+    using grad_type = tuple<order_dist_type, order_dev_type>;
+    // goods types are sorted and deduplicated, so that equal orders share the same process
+    order_type sorted = order;
+    std::sort(sorted.begin(), sorted.end());
+    sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+    if (sorted.size() > ORDER_MAX_GOODS) sorted.resize(ORDER_MAX_GOODS);
+    std::unordered_map<key_type, tuple<order_dist_type, order_dev_type, order_dev_type>> resmap = spawn(CALL, [&](key_type const& key){
+        order_type const& goods = get<1>(key);
+        bool reserved = node.current_time() < node.storage(tags::reservation_end{}) and node.storage(tags::reserved_by{}) != get<0>(key);
+        bool available = node.storage(tags::pallet_handled{}) == false and not reserved;
+        real_t penalty = 0.1*comm + congestion_weight * node.storage(tags::congestion{});
+        // distances, pallets and waypoints for every goods type
+        tuple<order_dist_type, order_dev_type, order_dev_type> r;
+        bool matching = false;
+        for (size_t i = 0; i < ORDER_MAX_GOODS; ++i) {
+            bool found = i < goods.size() and available and get<tags::goods_type>(node.storage(tags::loaded_goods{})) == goods[i];
+            matching = matching or found;
+            get<0>(r)[i] = found ? 0 : INF;
+            get<1>(r)[i] = found ? node.uid : no_device;
+            get<2>(r)[i] = node.uid;
+        }
+        grad_type none;
+        get<0>(none).fill(INF);
+        get<1>(none).fill(no_device);
+        nbr(CALL, none, [&](field<grad_type> x){
+            // the previous value of the device itself is excluded (avoiding count-to-infinity)
+            mod_self(CALL, x) = none;
+            r = fold_hood(CALL, [&](tuple<device_t, grad_type, real_t> n, tuple<order_dist_type, order_dev_type, order_dev_type> acc){
+                for (size_t i = 0; i < goods.size(); ++i) {
+                    real_t d = get<0>(get<1>(n))[i] + get<2>(n) + penalty;
+                    if (d < get<0>(acc)[i]) {
+                        get<0>(acc)[i] = d;
+                        get<1>(acc)[i] = get<1>(get<1>(n))[i];
+                        get<2>(acc)[i] = get<0>(n);
+                    }
+                }
+                return acc;
+            }, make_tuple(node.nbr_uid(), x, metric), r);
+            grad_type g{get<0>(r), get<1>(r)};
+            return make_tuple(g, g);
+        });
+        // the nearest pallet among all types, claimed by the wearable following the hop-count tree backwards
+        field<uint8_t> hops = hop_gradient(CALL, get<0>(key) == node.uid);
+        device_t chosen = no_device;
+        real_t best = INF;
+        for (size_t i = 0; i < goods.size(); ++i) if (get<0>(r)[i] < best) {
+            best = get<0>(r)[i];
+            chosen = get<1>(r)[i];
+        }
+        device_t claim = nbr(CALL, no_device, [&](field<device_t> c){
+            device_t x = get<0>(key) == node.uid ? chosen : get<1>(min_hood(CALL, make_tuple(hops, c), make_tuple(uint8_t{255}, no_device)));
+            return make_tuple(x, x);
+        });
+        if (matching and claim == node.uid) {
+            node.storage(tags::reserved_by{}) = get<0>(key);
+            node.storage(tags::reservation_end{}) = node.current_time() + RESERVATION_LEASE;
+        }
+        return make_tuple(r, get<0>(key) != node.uid ? status::internal : get<1>(key) == sorted ? status::internal_output : status::terminated);
+    }, sorted.empty() ? common::option<key_type>{} : common::option<key_type>{node.uid,sorted});
+    device_t waypoint = node.uid;
+    std::vector<device_t>& pallets = node.storage(tags::order_pallets{});
+    pallets.clear();
+    for (auto const& r : resmap) {
+        real_t best = INF;
+        for (size_t i = 0; i < sorted.size(); ++i) {
+            pallets.push_back(get<1>(r.second)[i]);
+            if (get<0>(r.second)[i] < best) {
+                best = get<0>(r.second)[i];
+                waypoint = get<2>(r.second)[i];
+            }
+        }
+    }
+    return waypoint;
+}
+//! @brief Export list for find_order.
+FUN_EXPORT find_order_t = export_list<spawn_t<tuple<device_t,order_type>, status>, tuple<order_dist_type, order_dev_type>, hop_gradient_t, device_t>;
 
 
 //! @brief Checks whether a vector of logs is sorted.
@@ -328,15 +827,37 @@ bool is_sorted(std::vector<log_type> const& v) {
     return true;
 }
 
-//! @brief Collects logs towards wearables of given UID parity.
-FUN std::vector<log_type> single_log_collection(ARGS, std::vector<log_type> const& new_logs, int parity) { CODE
-    bool source = node.uid % 2 == parity and node.storage(tags::node_type{}) == warehouse_device_type::Wearable;
-    field<uint8_t> nbrdist = nbr(CALL, std::numeric_limits<uint8_t>::max(), [&](field<uint8_t> d){
-        uint8_t nd = min_hood(CALL, d, std::numeric_limits<uint8_t>::max());
-        nd = source ? 0 : nd + 1;
-        mod_self(CALL, d) = nd;
-        return make_tuple(std::move(d), nd);
+//! @brief Replaces logs of aggregated types with counter logs per time bucket (on the device creating the logs).
+FUN void aggregate_logs(ARGS, std::vector<log_type>& logs, times_t current_clock) { CODE
+    int bucket = int(10*current_clock) / LOG_AGGREGATION_BUCKET;
+    old(CALL, make_tuple(bucket, log_counters_type{}), [&](tuple<int, log_counters_type> o){
+        log_counters_type& counters = get<1>(o);
+        // counters of a closed bucket are turned into counter logs
+        if (get<0>(o) != bucket) {
+            uint8_t bucket_time = get<0>(o) * LOG_AGGREGATION_BUCKET % 256;
+            for (uint8_t t=0; t<LOG_TYPE_NUM; ++t) if (counters[t] > 0)
+                insert_log(logs, log_type(LOG_TYPE_COUNTER + t, node.uid, bucket_time, counters[t]));
+            counters = {};
+            get<0>(o) = bucket;
+        }
+        // aggregated logs of the current round are counted and removed
+        size_t i = 0;
+        for (size_t j=0; j<logs.size(); ++j) {
+            uint8_t t = get<tags::log_content_type>(logs[j]);
+            if (t < LOG_TYPE_NUM and log_aggregated[t]) ++counters[t];
+            else logs[i++] = logs[j];
+        }
+        logs.resize(i);
+        return o;
     });
+}
+//! @brief Export list for aggregate_logs.
+FUN_EXPORT aggregate_logs_t = export_list<tuple<int, log_counters_type>>;
+
+
+//! @brief Collects logs towards the given source devices, returning the logs passing through the device (the collected ones on sources).
+FUN std::vector<log_type> single_log_collection(ARGS, std::vector<log_type> const& new_logs, bool source) { CODE
+    field<uint8_t> nbrdist = hop_gradient(CALL, source);
     uint8_t dist = self(CALL, nbrdist);
     std::vector<log_type> r = nbr(CALL, std::vector<log_type>{}, [&](field<std::vector<log_type>> nl){
         std::vector<log_type> uplogs   = sum_hood(CALL, mux(nbrdist > dist, nl, std::vector<log_type>{}));
@@ -344,21 +865,58 @@ FUN std::vector<log_type> single_log_collection(ARGS, std::vector<log_type> cons
         return (uplogs - downlogs) + new_logs;
     });
     assert(is_sorted(r));
-    return source ? r : std::vector<log_type>{};
+    return r;
 }
 //! @brief Export list for single_log_collection.
-FUN_EXPORT single_log_collection_t = export_list<uint8_t, std::vector<log_type>>;
+FUN_EXPORT single_log_collection_t = export_list<hop_gradient_t, std::vector<log_type>>;
 
-//! @brief Collects logs towards wearables with redundancy.
-FUN std::vector<log_type> log_collection(ARGS, std::vector<log_type> const& new_logs) { CODE
+/**
+ * @brief Collects logs towards sink devices with a given redundancy (between 1 and 3).
+ *
+ * Sinks are split into `redundancy` groups by their `sink_group`, and every log is routed
+ * towards the nearest sink of each group. Groups are assigned by the deployment among the
+ * actual sinks, which should include at least one sink per group.
+ * The logs passing through the device towards the first group are stored in `transit`.
+ */
+FUN std::vector<log_type> log_collection(ARGS, std::vector<log_type> const& new_logs, int redundancy, std::vector<log_type>& transit) { CODE
     assert(is_sorted(new_logs));
-    std::vector<log_type> r0 = single_log_collection(CALL, new_logs, 0);
-    std::vector<log_type> r1 = single_log_collection(CALL, new_logs, 1);
-    return r0.empty() ? r1 : r0;
+    assert(1 <= redundancy and redundancy <= 3);
+    bool sink = node.storage(tags::log_sink{});
+    int group = node.storage(tags::sink_group{});
+    assert(not sink or group < redundancy);
+    transit = single_log_collection(CALL, new_logs, sink and group == 0);
+    std::vector<log_type> r1, r2;
+    if (redundancy > 1) r1 = single_log_collection(CALL, new_logs, sink and group == 1);
+    if (redundancy > 2) r2 = single_log_collection(CALL, new_logs, sink and group == 2);
+    if (not sink) return {};
+    return group == 0 ? transit : group == 1 ? r1 : r2;
 }
 //! @brief Export list for log_collection.
 FUN_EXPORT log_collection_t = export_list<single_log_collection_t>;
 
+/**
+ * @brief Collects safety-critical logs towards the nearest sink, keeping at most SAFETY_LANE_CAPACITY of the most recent ones.
+ *
+ * The lane bounds its own size and is not held back by a backlog of other logs, but it travels
+ * in the same export: it is not forwarded ahead of them, and it is lost with them if the export is.
+ */
+FUN std::vector<log_type> safety_log_collection(ARGS, std::vector<log_type> const& new_logs, times_t current_clock) { CODE
+    assert(is_sorted(new_logs));
+    bool source = node.storage(tags::log_sink{});
+    field<uint8_t> nbrdist = hop_gradient(CALL, source);
+    uint8_t dist = self(CALL, nbrdist);
+    std::vector<log_type> r = nbr(CALL, std::vector<log_type>{}, [&](field<std::vector<log_type>> nl){
+        std::vector<log_type> uplogs   = sum_hood(CALL, mux(nbrdist > dist, nl, std::vector<log_type>{}));
+        std::vector<log_type> downlogs = sum_hood(CALL, mux(nbrdist < dist, nl, std::vector<log_type>{}));
+        std::vector<log_type> logs = (uplogs - downlogs) + new_logs;
+        cap_logs(logs, SAFETY_LANE_CAPACITY, discretizer(current_clock));
+        return logs;
+    });
+    return source ? r : std::vector<log_type>{};
+}
+//! @brief Export list for safety_log_collection.
+FUN_EXPORT safety_log_collection_t = export_list<hop_gradient_t, std::vector<log_type>>;
+
 
 //! @brief Computes some statistics for network analysis.
 FUN void statistics(ARGS, times_t current_clock) { CODE
@@ -366,38 +924,86 @@ FUN void statistics(ARGS, times_t current_clock) { CODE
     node.storage(tags::msg_size{}) = node.msg_size();
     node.storage(tags::msg_received__perc{}) = node.msg_size() <= MSG_SIZE_HARDWARE_LIMIT;
     // log size and delay stats
-    node.storage(tags::log_created{}) = node.storage(tags::new_logs{}).size();
-    node.storage(tags::log_collected{}) = node.storage(tags::coll_logs{}).size();
-    std::vector<times_t> delays;
-    for (auto const& log : node.storage(tags::coll_logs{})) {
-        uint8_t d = discretizer(current_clock) - get<tags::log_time>(log);
-        delays.push_back(d * 0.1);
-    }
-    node.storage(tags::logging_delay{}) = delays;
+    node.storage(tags::log_created{}) = node.storage(tags::new_logs{}).size() + node.storage(tags::new_safety_logs{}).size();
+    node.storage(tags::log_collected{}) = node.storage(tags::coll_logs{}).size() + node.storage(tags::coll_safety_logs{}).size();
+    delay_histogram& delays = node.storage(tags::logging_delay{});
+    delays.clear();
+    for (auto const& log : node.storage(tags::coll_logs{}))
+        delays.insert(discretizer(current_clock) - get<tags::log_time>(log));
+    delay_histogram& safety_delays = node.storage(tags::safety_delay{});
+    safety_delays.clear();
+    for (auto const& log : node.storage(tags::coll_safety_logs{}))
+        safety_delays.insert(discretizer(current_clock) - get<tags::log_time>(log));
 }
 //! @brief Export list for statistics.
 FUN_EXPORT statistics_t = export_list<>;
 
 
-//! @brief Application for warehouse assistance.
-FUN device_t warehouse_app(ARGS, real_t grid_step, real_t comm_rad, real_t safety_radius, real_t safe_speed) { CODE
-    bool is_pallet = node.storage(tags::node_type{}) == warehouse_device_type::Pallet;
+/**
+ * @brief Application for warehouse assistance, specialised for a device role.
+ *
+ * Waypoints avoid congested devices by `congestion_weight` per wearable routed through them
+ * (or standing within `grid_step`) in the previous round, spreading forklifts across aisles.
+ * With `local_space`, free slots are detected by pallets from one-hop distances only.
+ * Gradients and nearest pallets use neighbour distances filtered with gain `dist_filter`, for devices
+ * moving at a relative speed of at most `max_speed` and ranging errors within `grid_step`, or raw
+ * distances if `dist_filter` is 1.
+ * Routines reserved to wearables are compiled out of pallets (through `if constexpr`), while
+ * the searches for goods, spaces and collision risks run in both roles, since pallets are their
+ * sources and relays: they keep the same call points, so that pallets and wearables stay aligned.
+ */
+template <warehouse_device_type role, typename node_t>
+device_t warehouse_app(ARGS, real_t grid_step, real_t comm_rad, real_t safety_radius, real_t safe_speed, int log_redundancy, bool local_collisions, real_t congestion_weight, bool local_space, real_t dist_filter, real_t max_speed) { CODE
+    constexpr bool is_pallet = role == warehouse_device_type::Pallet;
     times_t current_clock = shared_clock(CALL);
     node.storage(tags::global_clock{}) = current_clock;
+    // per-round buffers of new logs are cleared and refilled in place, reusing their capacity
+    // (logs exchanged through fields and exports are still allocated by every round)
     std::vector<log_type>& logs = node.storage(tags::new_logs{});
-    logs = {};
-    logs = logs + load_goods_on_pallet(CALL, current_clock);
-    logs = logs + collision_detection(CALL, safety_radius, safe_speed, current_clock, comm_rad);
-    node.storage(tags::coll_logs{}) = log_collection(CALL, logs);
-    device_t space_waypoint = find_space(CALL, grid_step, comm_rad);
-    device_t goods_waypoint = find_goods(CALL, node.storage(tags::querying{}), comm_rad);
-    device_t waypoint = is_pallet ? node.uid : node.storage(tags::querying{}) == no_query ? space_waypoint : goods_waypoint;
-    node.storage(tags::led_on{}) = any_hood(CALL, nbr(CALL, (real_t)waypoint) == node.uid, false);
+    std::vector<log_type>& safety_logs = node.storage(tags::new_safety_logs{});
+    reserve_round_buffer(logs, ROUND_LOG_CAPACITY);
+    reserve_round_buffer(safety_logs, ROUND_LOG_CAPACITY);
+    logs.clear();
+    safety_logs.clear();
+    // neighbour distances, filtered unless dist_filter is 1
+    field<real_t> dist = dist_filter < 1 ? filtered_nbr_dist(CALL, dist_filter, max_speed, grid_step) : node.nbr_dist();
+    load_goods_on_pallet(CALL, dist, current_clock, logs);
+    aggregate_logs(CALL, logs, current_clock);
+    if (local_collisions) {
+        if constexpr (not is_pallet)
+            local_collision_detection(CALL, safety_radius, safe_speed, current_clock, safety_logs);
+    } else
+        collision_detection(CALL, dist, safety_radius, safe_speed, current_clock, comm_rad, safety_logs);
+    std::vector<log_type> transit;
+    node.storage(tags::coll_logs{}) = log_collection(CALL, logs, log_redundancy, transit);
+    node.storage(tags::coll_safety_logs{}) = safety_log_collection(CALL, safety_logs, current_clock);
+    if constexpr (not is_pallet)
+        update_goods_cache(CALL, transit);
+    device_t space_waypoint = find_space(CALL, dist, grid_step, comm_rad, congestion_weight, local_space);
+    device_t goods_waypoint = find_goods(CALL, dist, node.storage(tags::querying{}), comm_rad, congestion_weight);
+    device_t order_waypoint = find_order(CALL, dist, node.storage(tags::order{}), comm_rad, congestion_weight);
+    device_t waypoint = is_pallet ? node.uid :
+                        node.storage(tags::querying{}) != no_query ? goods_waypoint :
+                        node.storage(tags::order{}).empty() ? space_waypoint : order_waypoint;
+    field<real_t> nbr_waypoint = nbr(CALL, (real_t)waypoint);
+    node.storage(tags::led_on{}) = any_hood(CALL, nbr_waypoint == node.uid, false);
+    // the device itself does not count towards its congestion
+    node.storage(tags::congestion{}) = fold_hood(CALL, [&](tuple<device_t, real_t, uint8_t, real_t> t, int c){
+        return c + (get<0>(t) != node.uid and (get<1>(t) == node.uid or (get<2>(t) and get<3>(t) < grid_step)));
+    }, make_tuple(node.nbr_uid(), nbr_waypoint, nbr(CALL, uint8_t{not is_pallet}), node.nbr_dist()), 0);
     statistics(CALL, current_clock);
     return waypoint;
 }
+
+//! @brief Application for warehouse assistance, dispatching on the role of the device at runtime (for mixed networks).
+FUN device_t warehouse_app(ARGS, real_t grid_step, real_t comm_rad, real_t safety_radius, real_t safe_speed, int log_redundancy, bool local_collisions, real_t congestion_weight, bool local_space, real_t dist_filter, real_t max_speed) {
+    // forwarding the call point without tracing, so that both roles share the same traces
+    if (node.storage(tags::node_type{}) == warehouse_device_type::Pallet)
+        return warehouse_app<warehouse_device_type::Pallet>(node, call_point, grid_step, comm_rad, safety_radius, safe_speed, log_redundancy, local_collisions, congestion_weight, local_space, dist_filter, max_speed);
+    return warehouse_app<warehouse_device_type::Wearable>(node, call_point, grid_step, comm_rad, safety_radius, safe_speed, log_redundancy, local_collisions, congestion_weight, local_space, dist_filter, max_speed);
+}
 //! @brief Export list for warehouse_app.
-FUN_EXPORT warehouse_app_t = export_list<shared_clock_t, load_goods_on_pallet_t, collision_detection_t, find_space_t, find_goods_t, real_t, log_collection_t, statistics_t>;
+FUN_EXPORT warehouse_app_t = export_list<shared_clock_t, filtered_nbr_dist_t, load_goods_on_pallet_t, aggregate_logs_t, collision_detection_t, local_collision_detection_t, find_space_t, find_goods_t, find_order_t, real_t, uint8_t, log_collection_t, safety_log_collection_t, update_goods_cache_t, statistics_t>;
 
 } // namespace coordination
 
@@ -414,17 +1020,29 @@ using store_t = tuple_store<
     loaded_goods,           pallet_content_type,
     loading_goods,          pallet_content_type,
     querying,               query_type,
+    order,                  order_type,
+    order_pallets,          std::vector<device_t>,
+    goods_cache,            goods_cache_type,
+    goods_cache_logs,       std::vector<log_type>,
     new_logs,               std::vector<log_type>,
     coll_logs,              std::vector<log_type>,
+    new_safety_logs,        std::vector<log_type>,
+    coll_safety_logs,       std::vector<log_type>,
     led_on,                 bool,
+    congestion,             int,
     global_clock,           times_t,
     node_type,              warehouse_device_type,
+    log_sink,               bool,
+    sink_group,             uint8_t,
     msg_size,               size_t,
     msg_received__perc,     bool,
     log_collected,          size_t,
     log_created,            unsigned int,
-    logging_delay,          std::vector<times_t>,
-    pallet_handled,         bool
+    logging_delay,          delay_histogram,
+    safety_delay,           delay_histogram,
+    pallet_handled,         bool,
+    reserved_by,            device_t,
+    reservation_end,        times_t
 >;
 
 //! @brief Dictates that messages are thrown away after 5/1 seconds.
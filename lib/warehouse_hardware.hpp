@@ -25,6 +25,36 @@ constexpr size_t grid_cell_size = 50;
 //! @brief Communication radius (cm).
 constexpr size_t comm = 150;
 
+//! @brief Number of distinct sinks every log is routed to (between 1 and 3, and at most the number of deployed sinks).
+constexpr int log_redundancy = 1;
+
+//! @brief Whether collision risks are detected one-hop among wearables (instead of through multi-hop gradients).
+constexpr bool one_hop_collisions = false;
+
+//! @brief Routing penalty for every wearable routed through or standing near a device (0 to disable).
+constexpr fcpp::real_t congestion_weight = 0;
+//! @brief Whether free slots are detected locally by pallets (requires pallets on a regular grid).
+constexpr bool local_space_detection = false;
+//! @brief Gain of the filter of UWB neighbour distances (1 to disable filtering).
+constexpr fcpp::real_t dist_filter = 0.3;
+//! @brief Maximum relative speed between devices (cm/s, two forklifts at 10 km/h).
+constexpr fcpp::real_t max_relative_speed = 560;
+
+//! @brief Redundancy group of the sink (below log_redundancy), assigned to each deployed sink when flashing it.
+#ifdef SINK_GROUP
+constexpr uint8_t deployed_sink_group = SINK_GROUP;
+#else
+constexpr uint8_t deployed_sink_group = 0;
+#endif
+static_assert(deployed_sink_group < log_redundancy, "the sink group must be below the log redundancy");
+
+//! @brief The role of the device, fixed at compile time.
+#if IS_PALLET == 1
+constexpr warehouse_device_type device_role = warehouse_device_type::Pallet;
+#else
+constexpr warehouse_device_type device_role = warehouse_device_type::Wearable;
+#endif
+
 //! @brief Print operator for warehouse device type.
 template<typename O>
 O& operator<<(O& o, warehouse_device_type const& t) {
@@ -74,12 +104,11 @@ MAIN() {
     // number of neighbours (for debugging)
     node.storage(tags::nbr_count{}) = node.size();
     // set up node type
-#if IS_PALLET == 1
-    bool is_pallet = true;
-#else
-    bool is_pallet = false;
-#endif
-    node.storage(tags::node_type{}) = is_pallet ? warehouse_device_type::Pallet : warehouse_device_type::Wearable;
+    constexpr bool is_pallet = device_role == warehouse_device_type::Pallet;
+    node.storage(tags::node_type{}) = device_role;
+    // wearables act as log sinks, in the redundancy group they are flashed with
+    node.storage(tags::log_sink{}) = not is_pallet;
+    node.storage(tags::sink_group{}) = deployed_sink_group;
     // effect of button on pallets
     if (is_pallet and button_pressed) {
         if (node.storage(tags::pallet_handled{})) {
@@ -114,7 +143,7 @@ MAIN() {
         }
     }
     // calls main warehouse app
-    device_t waypoint = warehouse_app(CALL, grid_cell_size, comm, 0, 0); // TODO: tweak numbers
+    device_t waypoint = warehouse_app<device_role>(CALL, grid_cell_size, comm, 0, 0, log_redundancy, one_hop_collisions, congestion_weight, local_space_detection, dist_filter, max_relative_speed); // TODO: tweak numbers
     // checking if querying wearables has found its pallet
     if (not is_pallet and node.storage(tags::querying{}) != no_query) {
         if (waypoint != node.uid and details::self(node.nbr_dist(), waypoint) < 0.5*grid_cell_size) {
@@ -149,6 +178,7 @@ using rows_t = plot::rows<
         led_on,             bool,
         pallet_handled,     bool,
         new_logs,           std::vector<log_type>,
+        new_safety_logs,    std::vector<log_type>,
         msg_size,           uint8_t
     >,
     tuple_store<
@@ -7,8 +7,20 @@
 #ifndef FCPP_WAREHOUSE_SIMULATION_H_
 #define FCPP_WAREHOUSE_SIMULATION_H_
 
-#include <set>
+#include <algorithm>
+#include <cctype>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <list>
+#include <random>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
 
+#include "lib/allocation_counter.hpp"
+#include "lib/samplers.hpp"
 #include "lib/warehouse.hpp"
 
 #define WEARABLE_IDLE 0
@@ -19,37 +31,31 @@
 #define WEARABLE_INSERTED 5
 #define WEARABLE_RETRIEVED 6
 
-//! @brief Number of wearables (forklifts).
-constexpr size_t wearable_node_num = 6;
-//! @brief Number of empty pallets in loading zone.
-constexpr size_t empty_pallet_node_num = 10;
-//! @brief Number of stored pallets in aisles.
-constexpr size_t pallet_node_num = 500;
+//! @brief Maximum number of targets whose paths are cached by the navigation graph.
+#define NAVIGATION_CACHE_SIZE 256
 
-//! @brief The final simulation time (s).
-constexpr size_t end_time = 500;
+//! @brief Number of distinct sinks every log is routed to (between 1 and 3).
+constexpr int log_redundancy = 2;
 //! @brief Dimensionality of the space.
 constexpr size_t dim = 3;
-//! @brief Maximum communication radius in cm (25m wearable-w, 15m w-p, 9m p-p).
-constexpr size_t comm = 2500;
+//! @brief Maximum communication radius in cm (25m wearable-w, 15m w-p, 9m p-p), bounding the runtime one.
+constexpr size_t max_comm = 2500;
 //! @brief Maximum speed of forklifts (280 cm/s = 10 km/h).
 constexpr fcpp::real_t forklift_max_speed = 280;
+//! @brief Whether collision risks are detected one-hop among wearables (instead of through multi-hop gradients).
+constexpr bool one_hop_collisions = false;
+//! @brief Whether free slots are detected locally by pallets (instead of counting adjacent pallets).
+constexpr bool local_space_detection = false;
+//! @brief Gain of the filter of neighbour distances (1 to disable filtering, as simulated distances are exact).
+constexpr fcpp::real_t dist_filter = 1;
 
-//! @brief Bounds of the area (cm).
-constexpr size_t xside = 8550;
-constexpr size_t yside = 9450;
+//! @brief Bounds of the displayed area (cm).
+constexpr size_t view_xside = 8550;
+constexpr size_t view_yside = 9450;
 constexpr size_t height = 1000;
-//! @brief Distance between slots in aisles.
-constexpr size_t grid_cell_size = 150;
 //! @brief Threshold distance for position quantisation.
 constexpr size_t distance_to_consider_same_space = 100;
 
-//! @brief Bounds of the loading zone as grid indices.
-constexpr size_t loading_zone_bound_x_0 = grid_cell_size * 2;
-constexpr size_t loading_zone_bound_x_1 = grid_cell_size * 34;
-constexpr size_t loading_zone_bound_y_0 = grid_cell_size * 2;
-constexpr size_t loading_zone_bound_y_1 = grid_cell_size * 8;
-
 
 namespace fcpp {
 
@@ -71,9 +77,13 @@ namespace coordination {
         struct log_received__perc {};
         //! @brief Percentage of sent logs that are received twice.
         struct log_redundant__perc {};
+        //! @brief Percentage of sent safety-critical logs that are received somewhere.
+        struct safety_received__perc {};
+        //! @brief Number of heap allocations performed during the last round (by the whole program, FCPP included).
+        struct round_allocations {};
         //! @brief Simulation state of a wearable.
         struct wearable_sim_op {};
-        //! @brief Position of the target of a wearable.
+        //! @brief Position of the target of a wearable (or of the slot assigned to the pallet it is inserting).
         struct wearable_sim_target_pos {};
         //! @brief UID of the node a pallet follows.
         struct pallet_sim_follow {};
@@ -81,47 +91,709 @@ namespace coordination {
         struct pallet_sim_follow_pos {};
         //! @brief UID of the waypoint selected for the device.
         struct waypoint_uid {};
+        //! @brief Number of wearables (forklifts).
+        struct wearable_num {};
+        //! @brief Number of wearables acting as log sinks.
+        struct sink_wearable_num {};
+        //! @brief Number of stored pallets in aisles.
+        struct pallet_num {};
+        //! @brief Number of empty pallets in loading zone.
+        struct empty_pallet_num {};
+        //! @brief Number of goods types in the catalogue.
+        struct goods_num {};
+        //! @brief The final simulation time (s).
+        struct end_time {};
+        //! @brief Communication radius (cm).
+        struct comm_range {};
+        //! @brief Horizontal bound of the area (cm).
+        struct area_width {};
+        //! @brief Vertical bound of the area (cm).
+        struct area_height {};
+        //! @brief Distance between slots in aisles (cm).
+        struct cell_size {};
+        //! @brief Maximum period between rounds of quiescent devices (s).
+        struct max_round_period {};
+        //! @brief Routing penalty for every wearable routed through or standing near a device (cm).
+        struct congestion_penalty {};
+    }
+
+/**
+ * @brief Parameters of a simulated scenario, set at runtime.
+ *
+ * They are passed to networks through their initialisation tagged tuple,
+ * and can be read from `key=value` command line arguments or configuration files.
+ */
+struct scenario_type {
+    //! @brief Number of wearables (forklifts).
+    size_t wearables = 6;
+    //! @brief Number of wearables acting as log sinks (e.g. 1 for a single gateway at the loading dock).
+    size_t sink_wearables = 6;
+    //! @brief Number of stored pallets in aisles.
+    size_t pallets = 500;
+    //! @brief Number of empty pallets in loading zone.
+    size_t empty_pallets = 10;
+    //! @brief Number of goods types in the catalogue (at most UNDEFINED_GOODS).
+    size_t goods = 100;
+    //! @brief The final simulation time (s).
+    size_t end_time = 500;
+    //! @brief Communication radius of wearables in cm (at most max_comm).
+    size_t comm = max_comm;
+    //! @brief Bounds of the area (cm).
+    size_t xside = view_xside;
+    size_t yside = view_yside;
+    //! @brief Distance between slots in aisles.
+    size_t grid_cell_size = 150;
+    //! @brief Maximum period between rounds of quiescent devices in seconds (1 to disable, below the retain time of messages).
+    size_t max_round_period = 1;
+    //! @brief Routing penalty in cm for every wearable routed through or standing near a device (0 to disable, e.g. 300 for two grid cells).
+    size_t congestion_weight = 0;
+
+    //! @brief Default constructor (reference scenario).
+    scenario_type() = default;
+
+    //! @brief Constructor from a tagged tuple (with defaults for missing values).
+    template <typename S, typename T>
+    explicit scenario_type(common::tagged_tuple<S,T> const& t) {
+        wearables = common::get_or<tags::wearable_num>(t, wearables);
+        sink_wearables = common::get_or<tags::sink_wearable_num>(t, sink_wearables);
+        pallets = common::get_or<tags::pallet_num>(t, pallets);
+        empty_pallets = common::get_or<tags::empty_pallet_num>(t, empty_pallets);
+        goods = common::get_or<tags::goods_num>(t, goods);
+        end_time = common::get_or<tags::end_time>(t, end_time);
+        comm = common::get_or<tags::comm_range>(t, comm);
+        xside = common::get_or<tags::area_width>(t, xside);
+        yside = common::get_or<tags::area_height>(t, yside);
+        grid_cell_size = common::get_or<tags::cell_size>(t, grid_cell_size);
+        max_round_period = common::get_or<tags::max_round_period>(t, max_round_period);
+        congestion_weight = common::get_or<tags::congestion_penalty>(t, congestion_weight);
+    }
+
+    //! @brief The log redundancy, limited by the number of sinks (so that every group of sinks is non-empty).
+    int redundancy() const {
+        return std::max(1, std::min(log_redundancy, int(sink_wearables)));
+    }
+
+    //! @brief Bounds of the loading zone (cm).
+    size_t loading_zone_bound_x_0() const { return grid_cell_size * 2; }
+    size_t loading_zone_bound_x_1() const { return grid_cell_size * 34; }
+    size_t loading_zone_bound_y_0() const { return grid_cell_size * 2; }
+    size_t loading_zone_bound_y_1() const { return grid_cell_size * 8; }
+
+    //! @brief Sets a parameter by name (returns false on unknown names or invalid values).
+    bool set(std::string const& key, std::string const& value) {
+        size_t* field = key == "wearables" ? &wearables :
+                        key == "sink_wearables" ? &sink_wearables :
+                        key == "pallets" ? &pallets :
+                        key == "empty_pallets" ? &empty_pallets :
+                        key == "goods" ? &goods :
+                        key == "end_time" ? &end_time :
+                        key == "comm" ? &comm :
+                        key == "xside" ? &xside :
+                        key == "yside" ? &yside :
+                        key == "grid_cell_size" ? &grid_cell_size :
+                        key == "max_round_period" ? &max_round_period :
+                        key == "congestion_weight" ? &congestion_weight : nullptr;
+        if (field == nullptr) return false;
+        std::istringstream is(value);
+        return bool(is >> *field) and is.eof();
+    }
+
+    //! @brief Reads `key=value` lines from a stream (ignoring empty lines and comments starting with `#`).
+    bool read(std::istream& is) {
+        std::string line;
+        while (std::getline(is, line)) {
+            line = line.substr(0, line.find('#'));
+            if (line.find_first_not_of(" \t\r") == std::string::npos) continue;
+            if (not read(line)) return false;
+        }
+        return true;
+    }
+
+    //! @brief Reads a `key=value` argument (ignoring spaces).
+    bool read(std::string arg) {
+        arg.erase(std::remove_if(arg.begin(), arg.end(), [](char c){ return std::isspace(c); }), arg.end());
+        size_t eq = arg.find('=');
+        return eq != std::string::npos and set(arg.substr(0, eq), arg.substr(eq+1));
+    }
+
+    /**
+     * @brief Reads parameters from command line arguments, starting from `first`.
+     *
+     * Every argument is either a `key=value` pair or the name of a configuration file
+     * of `key=value` lines, with later values overriding earlier ones.
+     *
+     * @return Whether all arguments were read and the resulting scenario is consistent.
+     */
+    bool read(int argc, char** argv, int first = 1) {
+        for (int i = first; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg.find('=') != std::string::npos) {
+                if (not read(arg)) {
+                    std::cerr << "invalid scenario parameter: " << arg << std::endl;
+                    return false;
+                }
+            } else {
+                std::ifstream f(arg);
+                if (not f or not read(f)) {
+                    std::cerr << "invalid scenario file: " << arg << std::endl;
+                    return false;
+                }
+            }
+        }
+        if (sink_wearables > wearables or comm > max_comm or grid_cell_size == 0 or goods == 0 or goods > UNDEFINED_GOODS or max_round_period == 0 or max_round_period > 4) {
+            std::cerr << "inconsistent scenario (sink_wearables <= wearables, comm <= " << max_comm << ", grid_cell_size > 0, 0 < goods <= " << UNDEFINED_GOODS << ", 0 < max_round_period <= 4)" << std::endl;
+            return false;
+        }
+        return true;
+    }
+};
+
+//! @brief Makes a tagged tuple of initialisation values, with tags `Ss` and values `xs` followed by the parameters of a scenario.
+template <typename... Ss, typename... Ts>
+auto make_scenario_tuple(scenario_type const& s, Ts const&... xs) {
+    return common::make_tagged_tuple<Ss..., tags::wearable_num, tags::sink_wearable_num, tags::pallet_num, tags::empty_pallet_num, tags::goods_num, tags::end_time, tags::comm_range, tags::area_width, tags::area_height, tags::cell_size, tags::max_round_period, tags::congestion_penalty>(
+        xs..., s.wearables, s.sink_wearables, s.pallets, s.empty_pallets, s.goods, s.end_time, s.comm, s.xside, s.yside, s.grid_cell_size, s.max_round_period, s.congestion_weight
+    );
+}
+
+//! @brief Makes a sequence of batch initialisation values, with generators `gs` followed by the parameters of a scenario.
+template <typename... Gs>
+auto make_scenario_sequence(scenario_type const& s, Gs&&... gs) {
+    return batch::make_tagged_tuple_sequence(
+        std::forward<Gs>(gs)...,
+        batch::constant<tags::wearable_num>(s.wearables),
+        batch::constant<tags::sink_wearable_num>(s.sink_wearables),
+        batch::constant<tags::pallet_num>(s.pallets),
+        batch::constant<tags::empty_pallet_num>(s.empty_pallets),
+        batch::constant<tags::goods_num>(s.goods),
+        batch::constant<tags::end_time>(s.end_time),
+        batch::constant<tags::comm_range>(s.comm),
+        batch::constant<tags::area_width>(s.xside),
+        batch::constant<tags::area_height>(s.yside),
+        batch::constant<tags::cell_size>(s.grid_cell_size),
+        batch::constant<tags::max_round_period>(s.max_round_period),
+        batch::constant<tags::congestion_penalty>(s.congestion_weight)
+    );
+}
+
+/**
+ * @brief Writes to the storage of other nodes, deferred to the start of their next round.
+ *
+ * During a round, a node only writes its own storage: writes to other nodes are queued,
+ * and applied by the target node itself before its next round, so that rounds can run in parallel.
+ * Claims are exclusive: at most one claim can be pending on a node at a time, and it is held
+ * until the node releases it after publishing its updated snapshot (see node_snapshots).
+ */
+template <typename node_t>
+class deferred_writes {
+  public:
+    //! @brief Type of a queued write.
+    using write_type = std::function<void(node_t&)>;
+
+    //! @brief Queues a write for a device.
+    void push(device_t uid, write_type write) {
+        common::lock_guard<true> lock(m_mutex);
+        m_writes[uid].push_back(std::move(write));
+    }
+
+    //! @brief Queues a write claiming a device, if `available` holds and no other claim is pending (returns whether it succeeded).
+    template <typename F>
+    bool claim(device_t uid, F&& available, write_type write) {
+        common::lock_guard<true> lock(m_mutex);
+        if (m_claimed.count(uid) or not available()) return false;
+        m_claimed.insert(uid);
+        m_writes[uid].push_back(std::move(write));
+        return true;
+    }
+
+    //! @brief Applies the writes queued for a node (to be called by the node itself).
+    void apply(node_t& node) {
+        common::lock_guard<true> lock(m_mutex);
+        auto it = m_writes.find(node.uid);
+        if (it == m_writes.end()) return;
+        for (write_type const& w : it->second) w(node);
+        m_writes.erase(it);
+    }
+
+    //! @brief Releases the claim on a node, once its effects are visible to other nodes (to be called by the node itself).
+    void release(device_t uid) {
+        common::lock_guard<true> lock(m_mutex);
+        m_claimed.erase(uid);
+    }
+
+  private:
+    //! @brief Mutex guarding the queues.
+    common::mutex<true> m_mutex;
+
+    //! @brief Writes queued by target device.
+    std::unordered_map<device_t, std::vector<write_type>> m_writes;
+
+    //! @brief Devices with a pending claim.
+    std::unordered_set<device_t> m_claimed;
+};
+
+//! @brief The state of a node visible to other nodes, as published in its latest round.
+struct node_snapshot {
+    //! @brief Whether the node published any state.
+    bool known = false;
+    //! @brief Time of publication.
+    times_t time = 0;
+    //! @brief Position at the time of publication.
+    vec<dim> position = make_vec(0,0,0);
+    //! @brief Velocity at the time of publication.
+    vec<dim> velocity = make_vec(0,0,0);
+    //! @brief Whether the node is a Wearable or a Pallet.
+    warehouse_device_type type = warehouse_device_type::Pallet;
+    //! @brief The goods contained (on pallets).
+    pallet_content_type loaded_goods;
+    //! @brief Whether the pallet is being handled by a wearable.
+    bool pallet_handled = false;
+    //! @brief The wearable holding a reservation on the pallet.
+    device_t reserved_by = no_device;
+    //! @brief The time when the reservation of the pallet expires.
+    times_t reservation_end = 0;
+    //! @brief Position of the slot a pallet is moving to.
+    vec<dim> follow_pos = make_vec(0,0,0);
+
+    //! @brief Position extrapolated at a given time.
+    vec<dim> position_at(times_t t) const {
+        return position + velocity * (t - time);
+    }
+};
+
+/**
+ * @brief Snapshots of the state of nodes, through which nodes read each other during parallel rounds.
+ *
+ * Every node publishes its own snapshot at the start and end of its rounds, and other nodes
+ * only read copies of the snapshots, so that no node is read while its round is running.
+ */
+class node_snapshots {
+  public:
+    //! @brief Publishes the current state of a node (to be called by the node itself).
+    template <typename node_t>
+    void publish(node_t& node) {
+        node_snapshot s;
+        s.known = true;
+        s.time = node.current_time();
+        s.position = node.position();
+        s.velocity = node.velocity();
+        s.type = node.storage(tags::node_type{});
+        s.loaded_goods = node.storage(tags::loaded_goods{});
+        s.pallet_handled = node.storage(tags::pallet_handled{});
+        s.reserved_by = node.storage(tags::reserved_by{});
+        s.reservation_end = node.storage(tags::reservation_end{});
+        s.follow_pos = node.storage(tags::pallet_sim_follow_pos{});
+        common::lock_guard<true> lock(m_mutex);
+        m_snapshots[node.uid] = s;
+    }
+
+    //! @brief A copy of the latest snapshot of a node (not known if it never published one).
+    node_snapshot get(device_t uid) const {
+        common::lock_guard<true> lock(m_mutex);
+        auto it = m_snapshots.find(uid);
+        return it == m_snapshots.end() ? node_snapshot{} : it->second;
+    }
+
+  private:
+    //! @brief Mutex guarding the snapshots.
+    mutable common::mutex<true> m_mutex;
+
+    //! @brief The latest snapshot of every node.
+    std::unordered_map<device_t, node_snapshot> m_snapshots;
+};
+
+/**
+ * @brief Deduplication of received logs over a sliding window of their (reconstructed) times.
+ *
+ * Logs carry their time modulo 25.6s, so a log can only be recognised within that window:
+ * older entries are forgotten, keeping memory flat, while the counts stay exact.
+ */
+class received_log_window {
+  public:
+    //! @brief Type of a received log with its time in tenths of seconds.
+    using key_type = std::pair<int, log_type>;
+
+    //! @brief Records a log received by a sink group at a time, returning the groups which already received it.
+    uint8_t receive(int time, log_type const& log, uint8_t group, int now) {
+        while (not m_order.empty() and m_order.front().first < now - 256) {
+            m_groups.erase(m_order.front());
+            m_order.pop_front();
+        }
+        auto r = m_groups.emplace(key_type{time, log}, 0);
+        if (r.second) {
+            m_order.push_back(r.first->first);
+            ++m_received;
+        }
+        uint8_t groups = r.first->second;
+        r.first->second |= group;
+        return groups;
+    }
+
+    //! @brief Number of distinct logs received.
+    size_t received() const {
+        return m_received;
+    }
+
+  private:
+    //! @brief Hasher for received logs.
+    struct hasher {
+        size_t operator()(key_type const& k) const {
+            size_t h = k.first;
+            h = h * 31 + get<tags::log_content_type>(k.second);
+            h = h * 31 + get<tags::logger_id>(k.second);
+            h = h * 31 + get<tags::log_content>(k.second);
+            return h;
+        }
+    };
+
+    //! @brief Sink groups receiving every log in the window.
+    std::unordered_map<key_type, uint8_t, hasher> m_groups;
+
+    //! @brief Logs in the window, in order of first reception.
+    std::deque<key_type> m_order;
+
+    //! @brief Number of distinct logs received.
+    size_t m_received = 0;
+};
+
+//! @brief Occupancy bitmap of the grid cells of the warehouse (with pallets stacked up to three high).
+class slot_occupancy {
+  public:
+    //! @brief Constructor given the scenario.
+    slot_occupancy(scenario_type const& s) :
+        m_grid(s.grid_cell_size),
+        size_x(s.xside / s.grid_cell_size),
+        size_y(s.yside / s.grid_cell_size),
+        m_full(size_x * size_y * size_z, false) {}
+
+    //! @brief The cell containing a position.
+    tuple<int,int,int> cell(vec<dim> const& p) const {
+        return make_tuple(int(p[0] / m_grid), int(p[1] / m_grid), int(p[2] / m_grid));
+    }
+
+    //! @brief Whether a cell is occupied (or outside of the warehouse).
+    bool occupied(int x, int y, int z) const {
+        return not inside(x, y, z) or m_full[index(x, y, z)];
+    }
+
+    //! @brief Sets whether a cell is occupied.
+    void set(int x, int y, int z, bool full) {
+        if (inside(x, y, z)) m_full[index(x, y, z)] = full;
+    }
+
+  private:
+    //! @brief Number of cells along the vertical axis.
+    static constexpr int size_z = 3;
+
+    //! @brief Whether a cell is within the warehouse.
+    bool inside(int x, int y, int z) const {
+        return 0 <= x and x < size_x and 0 <= y and y < size_y and 0 <= z and z < size_z;
+    }
+
+    //! @brief Index of a cell in the bitmap.
+    size_t index(int x, int y, int z) const {
+        return (size_t(z) * size_y + y) * size_x + x;
+    }
+
+    //! @brief Distance between slots.
+    real_t m_grid;
+
+    //! @brief Number of cells along the horizontal axes.
+    int size_x, size_y;
+
+    //! @brief The bitmap.
+    std::vector<bool> m_full;
+};
+
+/**
+ * @brief Layout of racks and corridors of the warehouse, generated for arbitrary area sizes (in grid cells).
+ *
+ * Along x, racks two cells wide alternate with vertical corridors three cells wide.
+ * Along y, racks are split into blocks of 15 cells by horizontal corridors three cells wide,
+ * starting after the loading zone. Slots are stacked up to three high, and are assigned
+ * to stored pallets in a shuffled order computed once.
+ */
+class warehouse_layout {
+  public:
+    //! @brief Period of racks and vertical corridors along x.
+    static constexpr int period_x = 5;
+    //! @brief Period of rack blocks and horizontal corridors along y.
+    static constexpr int period_y = 18;
+    //! @brief Offset of the central cell of corridors within their period.
+    static constexpr int corridor_x = 3, corridor_y = 7;
+    //! @brief First cell of racks along y (after the loading zone).
+    static constexpr int first_y = 9;
+    //! @brief Number of slots stacked in a cell.
+    static constexpr int levels = 3;
+
+    //! @brief Constructor given the scenario and a seed for shuffling slots.
+    warehouse_layout(scenario_type const& s, uint_fast32_t seed) :
+        size_x(s.xside / s.grid_cell_size),
+        size_y(s.yside / s.grid_cell_size) {
+        for (int z = 0; z < levels; ++z)
+            for (int y = 0; y < size_y; ++y)
+                for (int x = 0; x < size_x; ++x)
+                    if (is_slot(x, y)) m_slots.push_back(make_tuple(x, y, z));
+        std::shuffle(m_slots.begin(), m_slots.end(), std::mt19937(seed));
+    }
+
+    //! @brief Whether a cell holds slots of a rack.
+    bool is_slot(int x, int y) const {
+        return 1 <= x and x < size_x - 1 and first_y <= y and y < size_y - 3 and
+               x % period_x < 2 and (y % period_y < corridor_y - 1 or y % period_y > corridor_y + 1);
+    }
+
+    //! @brief Whether a cell can be crossed by forklifts (not a slot, nor a lane beside a rack).
+    bool is_walkable(int x, int y) const {
+        return 0 <= x and x < size_x and 0 <= y and y < size_y and
+               not is_slot(x, y) and not is_slot(x - 1, y) and not is_slot(x + 1, y);
+    }
+
+    //! @brief The centre of the vertical corridor serving the racks at a given x coordinate.
+    real_t vertical_corridor(real_t x) const {
+        return int((x - 1) / period_x) * period_x + corridor_x + 0.5;
+    }
+
+    //! @brief Number of cells along the x axis.
+    int width() const {
+        return size_x;
+    }
+
+    //! @brief Number of cells along the y axis.
+    int height() const {
+        return size_y;
+    }
+
+    //! @brief Total number of slots.
+    size_t capacity() const {
+        return m_slots.size();
+    }
+
+    //! @brief Takes the next free slot in the shuffled order (returns false if none is left).
+    bool next_slot(slot_occupancy const& occupancy, tuple<int,int,int>& slot) {
+        for (; m_next < m_slots.size(); ++m_next) {
+            slot = m_slots[m_next];
+            if (not occupancy.occupied(get<0>(slot), get<1>(slot), get<2>(slot))) {
+                ++m_next;
+                return true;
+            }
+        }
+        return false;
+    }
+
+  private:
+    //! @brief Number of cells along the horizontal axes.
+    int size_x, size_y;
+
+    //! @brief The slots, in shuffled order.
+    std::vector<tuple<int,int,int>> m_slots;
+
+    //! @brief Index of the next slot to be assigned.
+    size_t m_next = 0;
+};
+
+/**
+ * @brief Navigation graph of the walkable cells of a layout, with shortest paths cached by target.
+ *
+ * Paths towards a target cell are computed for every source at once through a breadth-first
+ * search, preferring straight moves among shortest paths, and stored as the next turning point
+ * from every cell. The paths of the NAVIGATION_CACHE_SIZE most recent targets are kept.
+ */
+class navigation_graph {
+  public:
+    //! @brief Constructor given the layout.
+    navigation_graph(warehouse_layout const& layout) : size_x(layout.width()), size_y(layout.height()), m_walkable(size_x * size_y) {
+        for (int y = 0; y < size_y; ++y)
+            for (int x = 0; x < size_x; ++x)
+                m_walkable[y * size_x + x] = layout.is_walkable(x, y);
+    }
+
+    //! @brief The next waypoint from position `p` towards position `q` (in cells).
+    vec<3> waypoint(vec<3> const& p, vec<3> const& q) {
+        int c = cell(p[0], p[1]);
+        int s = access(p[0], p[1]);
+        int t = access(q[0], q[1]);
+        // reaching the target from its access cell (or directly, if it cannot be reached)
+        if (s < 0 or t < 0 or s == t) return make_vec(q[0], q[1], 0);
+        // entering the graph from a rack
+        if (c != s) return centre(s);
+        common::lock_guard<true> lock(m_mutex);
+        int w = paths(t)[s];
+        return w < 0 ? make_vec(q[0], q[1], 0) : centre(w);
+    }
+
+  private:
+    //! @brief The cell containing a position (-1 if outside of the area).
+    int cell(real_t x, real_t y) const {
+        if (x < 0 or y < 0 or x >= size_x or y >= size_y) return -1;
+        return int(y) * size_x + int(x);
+    }
+
+    //! @brief The nearest walkable cell in the same row of a position, within two cells (-1 if none).
+    int access(real_t x, real_t y) const {
+        int c = cell(x, y);
+        if (c < 0) return -1;
+        for (int d = 0; d <= 2; ++d)
+            for (int i : {c % size_x - d, c % size_x + d})
+                if (0 <= i and i < size_x and m_walkable[c - c % size_x + i])
+                    return c - c % size_x + i;
+        return -1;
+    }
+
+    //! @brief The centre of a cell.
+    vec<3> centre(int c) const {
+        return make_vec(c % size_x + 0.5, c / size_x + 0.5, 0);
     }
 
+    //! @brief The walkable neighbours of a cell.
+    std::vector<int> neighbours(int c) const {
+        std::vector<int> n;
+        int x = c % size_x, y = c / size_x;
+        if (x > 0 and m_walkable[c - 1]) n.push_back(c - 1);
+        if (x + 1 < size_x and m_walkable[c + 1]) n.push_back(c + 1);
+        if (y > 0 and m_walkable[c - size_x]) n.push_back(c - size_x);
+        if (y + 1 < size_y and m_walkable[c + size_x]) n.push_back(c + size_x);
+        return n;
+    }
+
+    //! @brief The next turning point from every cell towards a target (-1 if unreachable), computing it if not cached.
+    std::vector<int> const& paths(int t) {
+        auto it = m_paths.find(t);
+        if (it != m_paths.end()) {
+            m_recent.splice(m_recent.begin(), m_recent, it->second.second);
+            return it->second.first;
+        }
+        if (m_paths.size() >= NAVIGATION_CACHE_SIZE) {
+            m_paths.erase(m_recent.back());
+            m_recent.pop_back();
+        }
+        m_recent.push_front(t);
+        std::vector<int>& turn = m_paths.emplace(t, std::make_pair(std::vector<int>(m_walkable.size(), -1), m_recent.begin())).first->second.first;
+        // distances from the target, and cells in order of distance
+        std::vector<int> dist(m_walkable.size(), -1), order{t}, next(m_walkable.size(), -1);
+        dist[t] = 0;
+        for (size_t i = 0; i < order.size(); ++i)
+            for (int n : neighbours(order[i]))
+                if (dist[n] < 0) {
+                    dist[n] = dist[order[i]] + 1;
+                    order.push_back(n);
+                }
+        // next hops (going straight if possible) and next turning points
+        for (size_t i = 1; i < order.size(); ++i) {
+            int c = order[i];
+            for (int n : neighbours(c))
+                if (dist[n] == dist[c] - 1) {
+                    if (next[c] < 0) next[c] = n;
+                    if (n != t and next[n] - n == n - c) {
+                        next[c] = n;
+                        break;
+                    }
+                }
+            int n = next[c];
+            turn[c] = n != t and next[n] - n == n - c ? turn[n] : n;
+        }
+        return turn;
+    }
+
+    //! @brief Number of cells along the horizontal axes.
+    int size_x, size_y;
+
+    //! @brief Whether every cell is walkable.
+    std::vector<bool> m_walkable;
+
+    //! @brief Mutex guarding the cache.
+    common::mutex<true> m_mutex;
+
+    //! @brief Cached targets, from the most recently used.
+    std::list<int> m_recent;
+
+    //! @brief Next turning points by target, with their position in the list of recent targets.
+    std::unordered_map<int, std::pair<std::vector<int>, std::list<int>::iterator>> m_paths;
+};
+
+//! @brief The global state of a simulation run (held by its network, see component::warehouse_state).
+template <typename node_t>
+struct simulation_state {
+    //! @brief Constructor from the initialisation tagged tuple of the network.
+    template <typename S, typename T>
+    explicit simulation_state(common::tagged_tuple<S,T> const& t) :
+        scenario(t),
+        occupancy(scenario),
+        layout(scenario, common::get_or<component::tags::seed>(t, 0)),
+        navigation(layout),
+        stocking(samplers::zipf_table(scenario.goods)),
+        inventory(scenario.goods) {}
+
+    //! @brief The parameters of the scenario.
+    scenario_type const scenario;
+    //! @brief The writes pending on nodes.
+    deferred_writes<node_t> pending_writes;
+    //! @brief The state of nodes visible to other nodes.
+    node_snapshots snapshots;
+    //! @brief Mutex guarding the statistics below.
+    common::mutex<true> mutex;
+    //! @brief Slots in aisles occupied by pallets (or assigned to pallets being stored).
+    slot_occupancy occupancy;
+    //! @brief Layout of racks and corridors.
+    warehouse_layout layout;
+    //! @brief Navigation graph of forklifts.
+    navigation_graph navigation;
+    //! @brief Number of wearables set up as log sinks.
+    size_t sink_wearables = 0;
+    //! @brief Distribution of goods types in stored pallets at start (Zipf).
+    samplers::alias_table const stocking;
+    //! @brief Number of pallets loaded with each goods type.
+    samplers::fenwick_sampler inventory;
+    //! @brief Number of logs created.
+    unsigned int total_created_logs = 0;
+    //! @brief Recently received logs (with reconstructed time), with the sink groups receiving them.
+    received_log_window received_logs;
+    //! @brief Number of received logs reaching more than one sink group.
+    size_t redundant_logs = 0;
+    //! @brief Number of safety-critical logs created.
+    unsigned int total_created_safety_logs = 0;
+    //! @brief Recently received safety-critical logs (with reconstructed time).
+    received_log_window received_safety_logs;
+};
+
+//! @brief Queues a write of a storage value of another node.
+template <typename T, typename node_t, typename V>
+void defer_storage(node_t& node, device_t uid, V const& value) {
+    node.net.simulation().pending_writes.push(uid, [value](node_t& target){
+        target.storage(T{}) = value;
+    });
+}
+
+//! @brief Queues a claim of a pallet by setting its handled flag, if its snapshot is available, freeing its slot (returns whether it succeeded).
+template <typename node_t, typename F>
+bool claim_pallet(node_t& node, device_t uid, F&& available) {
+    auto& state = node.net.simulation();
+    node_snapshot target;
+    bool claimed = state.pending_writes.claim(uid, [&](){
+        target = state.snapshots.get(uid);
+        return target.known and target.pallet_handled == false and available(target);
+    }, [](node_t& pallet){
+        pallet.storage(tags::pallet_handled{}) = true;
+    });
+    if (claimed) {
+        common::lock_guard<true> lock(state.mutex);
+        auto c = state.occupancy.cell(target.position);
+        state.occupancy.set(get<0>(c), get<1>(c), get<2>(c), false);
+    }
+    return claimed;
+}
+
 //! @brief Generates a random good type according to a ZIPF distribution.
 FUN uint8_t random_good(ARGS) { CODE
-    constexpr real_t f = 5.187377517639621;
-    real_t r = node.next_real(f);
-    for (uint8_t i=1; ; ++i) {
-        r -= real_t(1)/i;
-        if (r < 0) return i-1;
-    }
-    return 99;
+    return node.net.simulation().stocking.sample(node.next_real(1));
 }
 
-//! @brief Computes the next waypoint towards target q while avoiding obstacles.
+//! @brief Computes the next waypoint towards target q while avoiding obstacles (along shortest corridor paths).
 FUN vec<3> waypoint_target(ARGS, vec<3> q) { CODE
-    // rescale for convenience
-    vec<3> p = node.position() / grid_cell_size;
-    q /= grid_cell_size;
-    // discretized target x
-    real_t qx = int((q[0]-1)/5) * 5 + 3.5;
-    // if close to target
-    if (abs(qx-p[0]) <= 2.5 and abs(q[1]-p[1]) <= 1)
-        return make_vec(q[0], q[1], 0) * grid_cell_size;
-    // if same vertical corridor as target
-    if (abs(qx-p[0]) <= 1)
-        return make_vec(p[0], q[1], 0) * grid_cell_size;
-    // if in horizontal corridor
-    if (int(p[1])%18 == 7)
-        return make_vec(qx, p[1], 0) * grid_cell_size;
-    // if in vertical corridor
-    if (int(p[0])%5 == 3) {
-        vec<3> sp = constant(CALL, p); // starting position in the corridor
-        real_t qy = int((p[1] - 7.5)/18) * 18 + 7.5;
-        if (q[1] > qy + 3 and (q[1] > sp[1] or q[1] > qy + 15)) qy += 18;
-        return make_vec(p[0], qy, 0) * grid_cell_size;
-    }
-    // otherwise
-    qx = int((p[0]-1)/5) * 5 + 3.5;
-    return make_vec(qx, p[1], 0) * grid_cell_size;
+    auto& state = node.net.simulation();
+    size_t grid_cell_size = state.scenario.grid_cell_size;
+    return state.navigation.waypoint(node.position() / grid_cell_size, q / grid_cell_size) * grid_cell_size;
 }
-FUN_EXPORT waypoint_target_t = export_list<constant_t<vec<dim>>>;
 
 //! @brief Horizontal distance towards another position.
 FUN real_t distance_from(ARGS, vec<dim> const& other) { CODE
@@ -138,28 +810,30 @@ FUN void stop_mov(ARGS) { CODE
     node.velocity() = make_vec(0,0,0);
 }
 
-//! @brief Finds an empty slot in the vicinity of a given device.
+//! @brief Finds an empty slot in the vicinity of a given device (and marks it as occupied).
 FUN vec<dim> find_actual_space(ARGS, device_t near) { CODE
-    std::set<tuple<int,int,int>> full;
-    for (device_t n : details::get_ids(node.nbr_uid())) {
-        vec<dim> p = node.net.node_at(n).position() / grid_cell_size - make_vec(0.5, 0.5, 0.5);
-        full.emplace(p[0], p[1], p[2]);
-    }
-    int nx = node.net.node_at(near).position()[0] / grid_cell_size;
-    int ny = node.net.node_at(near).position()[1] / grid_cell_size;
+    auto& state = node.net.simulation();
+    size_t grid_cell_size = state.scenario.grid_cell_size;
+    vec<dim> p = state.snapshots.get(near).position;
+    common::lock_guard<true> lock(state.mutex);
+    int nx = p[0] / grid_cell_size;
+    int ny = p[1] / grid_cell_size;
     std::vector<vec<dim>> spaces;
     for (int y = ny-1; y <= ny+1; ++y)
-        if ((y+18) % 18 < 6 or y % 18 > 8)
-            for (int z = 0; z <= 2; ++z)
-                if (full.count({nx,y,z}) == 0)
+        if (state.layout.is_slot(nx, y))
+            for (int z = 0; z < warehouse_layout::levels; ++z)
+                if (not state.occupancy.occupied(nx,y,z))
                     spaces.push_back(make_vec(nx,y,z));
     if (spaces.size() == 0) spaces.push_back(make_vec(nx,ny,10));
-    return (spaces[node.next_int(spaces.size()-1)] + make_vec(0.5, 0.5, 0.5)) * grid_cell_size;
+    vec<dim> space = spaces[node.next_int(spaces.size()-1)];
+    state.occupancy.set(space[0], space[1], space[2], true);
+    return (space + make_vec(0.5, 0.5, 0.5)) * grid_cell_size;
  }
 
 //! @brief Tunes displaying properties of nodes based on their status.
 FUN void update_node_visually_in_simulation(ARGS) { CODE
     using namespace tags;
+    size_t grid_cell_size = node.net.simulation().scenario.grid_cell_size;
     uint8_t current_loaded_good;
     if (node.storage(node_type{}) == warehouse_device_type::Pallet) {
         node.storage(node_size{}) = node.storage(led_on{}) ? grid_cell_size : (grid_cell_size * 2) / 3;
@@ -193,136 +867,159 @@ FUN void update_node_visually_in_simulation(ARGS) { CODE
     }
 }
 
-std::set<tuple<int,int,int>> used_slots;
-std::vector<int> goods_counter(100, 0);
-
-//! @brief Setting up initial properties of nodes during the first simulation round.
-FUN void setup_nodes_if_first_round_of_simulation(ARGS) { CODE
-    if (coordination::counter(CALL) == 1 and
-            node.storage(tags::node_type{}) == warehouse_device_type::Pallet) {
-        if (node.position()[0] > loading_zone_bound_x_1 and
-                node.position()[1] > loading_zone_bound_y_1) {
-            int row, col, height;
-            real_t x, y, z;
-            do {
-                row = node.next_int(1,22);
-                col = node.next_int(0,44);
-                height = node.next_int(0,2);
-                x = ((((row / 2) * 3) + row) * grid_cell_size) + (grid_cell_size / 2);
-                y = ((((col / 15) * 3) + col + 9) * grid_cell_size) + (grid_cell_size / 2);
-                z = height * grid_cell_size + (grid_cell_size / 2);
-            } while (used_slots.find(make_tuple(row,col,height)) != used_slots.end());
-            used_slots.insert(make_tuple(row,col,height));
-            node.position() = make_vec(x,y,z);
+//! @brief Setting up initial properties of nodes during the first simulation round (returns whether it is the first round).
+FUN bool setup_nodes_if_first_round_of_simulation(ARGS) { CODE
+    if (coordination::counter(CALL) > 1) return false;
+    auto& state = node.net.simulation();
+    scenario_type const& sc = state.scenario;
+    size_t grid_cell_size = sc.grid_cell_size;
+    // scaling down communication power to the scenario radius
+    node.connector_data() *= sqrt(real_t(sc.comm) / max_comm);
+    if (node.storage(tags::node_type{}) == warehouse_device_type::Wearable) {
+        common::lock_guard<true> lock(state.mutex);
+        node.storage(tags::log_sink{}) = state.sink_wearables < sc.sink_wearables;
+        // sinks are assigned to redundancy groups in turn
+        node.storage(tags::sink_group{}) = state.sink_wearables % sc.redundancy();
+        state.sink_wearables += node.storage(tags::log_sink{});
+        node.position() = make_vec(node.next_real(sc.loading_zone_bound_x_0(), sc.loading_zone_bound_x_1()), node.next_real(sc.loading_zone_bound_y_0(), sc.loading_zone_bound_y_1()), 0);
+    } else {
+        common::lock_guard<true> lock(state.mutex);
+        tuple<int,int,int> slot;
+        // stored pallets are spawned with undefined goods (and left empty if no slot is left)
+        if (node.storage(tags::loaded_goods{}) == null_content and state.layout.next_slot(state.occupancy, slot)) {
+            state.occupancy.set(get<0>(slot), get<1>(slot), get<2>(slot), true);
+            node.position() = (make_vec(get<0>(slot), get<1>(slot), get<2>(slot)) + make_vec(0.5, 0.5, 0.5)) * grid_cell_size;
             uint8_t init_good = random_good(CALL);
             node.storage(tags::loaded_goods{}) = init_good;
-            goods_counter[init_good] = goods_counter[init_good] + 1;
+            state.inventory.add(init_good, +1);
         } else {
-            node.position() = make_vec(loading_zone_bound_x_0 + (node.next_int(1, 33) * grid_cell_size), loading_zone_bound_y_0 + (node.next_int(0, 3) * grid_cell_size), 0);
+            node.storage(tags::loaded_goods{}) = no_content;
+            node.position() = make_vec(sc.loading_zone_bound_x_0() + (node.next_int(1, 33) * grid_cell_size), sc.loading_zone_bound_y_0() + (node.next_int(0, 3) * grid_cell_size), 0);
         }
     }
+    return true;
 }
 FUN_EXPORT setup_nodes_if_first_round_of_simulation_t = export_list<counter_t<>>;
 
-unsigned int total_created_logs = 0;
-std::set<std::pair<int, log_type>> received_logs[4];
-
 //! @brief Computes additional statistics for simulation only.
 FUN void simulation_statistics(ARGS) { CODE
-    total_created_logs += node.storage(tags::new_logs{}).size();
+    auto& state = node.net.simulation();
+    common::lock_guard<true> lock(state.mutex);
+    state.total_created_logs += node.storage(tags::new_logs{}).size();
+    state.total_created_safety_logs += node.storage(tags::new_safety_logs{}).size();
+    int now = node.current_time()*10;
+    // time of a log in tenths of seconds, reconstructed from its time modulo 25.6s
+    auto log_time = [now](log_type const& log) {
+        int i = round((now - get<tags::log_time>(log)) / 256.0);
+        return 256 * i + get<tags::log_time>(log);
+    };
+    uint8_t group = 1 << node.storage(tags::sink_group{});
     for (auto const& log : node.storage(tags::coll_logs{})) {
-        int i = round((node.current_time()*10 - get<tags::log_time>(log)) / 256);
-        i = 256 * i + get<tags::log_time>(log);
-        received_logs[node.uid % 2].emplace(i, log);
-        received_logs[2].emplace(i, log);
-        if (received_logs[(node.uid + 1) % 2].count({i, log}))
-            received_logs[3].emplace(i, log);
-    }
-    node.storage(tags::log_received__perc{}) = received_logs[2].size() / (double)total_created_logs;
-    node.storage(tags::log_redundant__perc{}) = received_logs[3].size() / (double)total_created_logs;
+        uint8_t groups = state.received_logs.receive(log_time(log), log, group, now);
+        // counted once, as soon as a second group receives it
+        if (groups != 0 and (groups & group) == 0 and (groups & (groups - 1)) == 0)
+            ++state.redundant_logs;
+    }
+    // safety-critical logs are routed to the nearest sink regardless of groups
+    for (auto const& log : node.storage(tags::coll_safety_logs{}))
+        state.received_safety_logs.receive(log_time(log), log, 1, now);
+    node.storage(tags::log_received__perc{}) = state.received_logs.received() / (double)state.total_created_logs;
+    node.storage(tags::log_redundant__perc{}) = state.redundant_logs / (double)state.total_created_logs;
+    node.storage(tags::safety_received__perc{}) = state.total_created_safety_logs == 0 ? 1 : state.received_safety_logs.received() / (double)state.total_created_safety_logs;
 }
 
 //! @brief Simulation logic to be run before the main warehouse app.
 FUN void update_simulation_pre_program(ARGS) { CODE
-    common::unique_lock<false> lock;
+    auto& state = node.net.simulation();
+    scenario_type const& sc = state.scenario;
     device_t nearest_pallet = nearest_pallet_device(CALL);
     if (node.storage(tags::node_type{}) == warehouse_device_type::Wearable) {
         wearable_sim_state_type current_state = node.storage(tags::wearable_sim_op{});
+        // the pallet handled by the wearable, as last published
+        node_snapshot target = state.snapshots.get(get<2>(current_state));
+        vec<dim> target_position = target.position_at(node.current_time());
         if (get<0>(current_state) == WEARABLE_IDLE) {
             if (node.next_int(1,20) == 1) { // 20% change to start acting
                 uint8_t new_action = node.next_int(1,2);
-                uint8_t new_good = node.next_int(0,99);
-                if (new_action == WEARABLE_RETRIEVE) { // use a good that is somewhere
-                    bool found = false;
-                    while (!found) {
-                        new_good = node.next_int(0,99);
-                        if (goods_counter[new_good] > 0) {
-                            found = true;
+                uint8_t new_good = node.next_int(sc.goods - 1);
+                if (new_action == WEARABLE_RETRIEVE) { // use a good that is somewhere (weighted by its stock)
+                    common::lock_guard<true> lock(state.mutex);
+                    if (state.inventory.total() > 0) {
+                        new_good = state.inventory.sample(node.next_int(state.inventory.total() - 1));
+                        // half of the retrievals accept any goods of an order, searched as a whole
+                        if (node.next_int(1) == 1) {
+                            order_type& order = node.storage(tags::order{});
+                            order.push_back(new_good);
+                            for (int i = 1; i < ORDER_MAX_GOODS; ++i)
+                                order.push_back(state.inventory.sample(node.next_int(state.inventory.total() - 1)));
                         }
-                    }
+                    } else new_action = WEARABLE_IDLE;
                 }
-                node.storage(tags::wearable_sim_op{}) = make_tuple(new_action, new_good, 0);
+                if (new_action != WEARABLE_IDLE)
+                    node.storage(tags::wearable_sim_op{}) = make_tuple(new_action, new_good, 0);
             }
         } else if (get<0>(current_state) == WEARABLE_INSERT) {
             if (get<2>(current_state) == 0) {
                 for (auto search_candidate : details::get_ids(node.nbr_uid())) {
-                    if (node.net.node_count(search_candidate) and
-                            node.net.node_at(search_candidate).storage(tags::node_type{}) == warehouse_device_type::Pallet and
-                            get<tags::goods_type>(node.net.node_at(search_candidate).storage(tags::loaded_goods{})) == NO_GOODS and
-                            node.net.node_at(search_candidate).storage(tags::pallet_handled{}) == false) {
+                    if (claim_pallet(node, search_candidate, [](node_snapshot const& pallet){
+                            return pallet.type == warehouse_device_type::Pallet and
+                                   get<tags::goods_type>(pallet.loaded_goods) == NO_GOODS;
+                        })) {
                         node.storage(tags::wearable_sim_op{}) = make_tuple(WEARABLE_INSERT, get<1>(current_state), search_candidate);
-                        node.net.node_at(search_candidate, lock).storage(tags::pallet_handled{}) = true;
                         break;
                     }
                 }
-            } else if (node.net.node_count(get<2>(current_state)) and
-                        distance_from(CALL, node.net.node_at(get<2>(current_state)).position()) < distance_to_consider_same_space and
+            } else if (target.known and
+                        distance_from(CALL, target_position) < distance_to_consider_same_space and
                         nearest_pallet == get<2>(current_state)) {
-                if (get<tags::goods_type>(node.net.node_at(get<2>(current_state)).storage(tags::loaded_goods{})) == get<1>(current_state)) {
-                    node.net.node_at(get<2>(current_state), lock).storage(tags::pallet_sim_follow{}) = node.uid;
+                if (get<tags::goods_type>(target.loaded_goods) == get<1>(current_state)) {
+                    defer_storage<tags::pallet_sim_follow>(node, get<2>(current_state), node.uid);
                     node.storage(tags::wearable_sim_op{}) = make_tuple(WEARABLE_INSERTING, get<1>(current_state), get<2>(current_state));
                 } else {
                     node.storage(tags::loading_goods{}) = common::make_tagged_tuple<tags::goods_type>(get<1>(current_state));
                 }
             }
         } else if (get<0>(current_state) == WEARABLE_RETRIEVE) {
-            node.storage(tags::querying{}) = common::make_tagged_tuple<coordination::tags::goods_type>(get<1>(current_state));
-        } else if (get<0>(current_state) == WEARABLE_RETRIEVING and
-                    node.net.node_count(get<2>(current_state))) {
+            if (node.storage(tags::order{}).empty())
+                node.storage(tags::querying{}) = common::make_tagged_tuple<coordination::tags::goods_type>(get<1>(current_state));
+        } else if (get<0>(current_state) == WEARABLE_RETRIEVING and target.known) {
             if (make_vec(0,0,0) == node.storage(tags::wearable_sim_target_pos{})) {
-                node.net.node_at(get<2>(current_state), lock).storage(tags::pallet_sim_follow{}) = node.uid;
+                defer_storage<tags::pallet_sim_follow>(node, get<2>(current_state), node.uid);
                 node.storage(tags::querying{}) = no_query;
-                int random_x = node.next_int(loading_zone_bound_x_0, loading_zone_bound_x_1);
-                int random_y = loading_zone_bound_y_0 + (node.next_int(0, 3) * grid_cell_size);
+                node.storage(tags::order{}).clear();
+                int random_x = node.next_int(sc.loading_zone_bound_x_0(), sc.loading_zone_bound_x_1());
+                int random_y = sc.loading_zone_bound_y_0() + (node.next_int(0, 3) * sc.grid_cell_size);
                 node.storage(tags::wearable_sim_target_pos{}) = make_vec(random_x, random_y, 0);
             } else if (distance_from(CALL, node.storage(tags::wearable_sim_target_pos{})) < distance_to_consider_same_space and
-                    distance_from(CALL, node.net.node_at(get<2>(current_state)).position()) < distance_to_consider_same_space and
+                    distance_from(CALL, target_position) < distance_to_consider_same_space and
                     nearest_pallet == get<2>(current_state)) {
-                if (node.net.node_at(get<2>(current_state)).storage(tags::loaded_goods{}) == no_content) {
-                    real_t offs = 3 * grid_cell_size;
-                    real_t y = max(loading_zone_bound_y_0 + offs, min(node.position()[1], loading_zone_bound_y_1 - offs));
+                if (target.loaded_goods == no_content) {
+                    real_t offs = 3 * sc.grid_cell_size;
+                    real_t y = max(sc.loading_zone_bound_y_0() + offs, min(node.position()[1], sc.loading_zone_bound_y_1() - offs));
                     y = node.next_real(y-offs, y+offs);
                     node.storage(tags::wearable_sim_target_pos{}) = make_vec(node.position()[0], y, 0);
                     node.storage(tags::wearable_sim_op{}) = make_tuple(WEARABLE_RETRIEVED, get<1>(current_state), get<2>(current_state));
                 } else if (node.storage(tags::loading_goods{}) == null_content) {
-                    node.net.node_at(get<2>(current_state), lock).storage(tags::pallet_sim_follow{}) = 0;
-                    goods_counter[get<1>(current_state)] = goods_counter[get<1>(current_state)] - 1;
+                    defer_storage<tags::pallet_sim_follow>(node, get<2>(current_state), device_t(0));
+                    common::lock_guard<true> lock(state.mutex);
+                    state.inventory.add(get<1>(current_state), -1);
                     node.storage(tags::loading_goods{}) = no_content;
                 }
             }
         } else if (get<0>(current_state) == WEARABLE_RETRIEVED) {
             if (distance_from(CALL, node.storage(tags::wearable_sim_target_pos{})) < distance_to_consider_same_space) {
-                node.net.node_at(get<2>(current_state), lock).storage(tags::pallet_handled{}) = false;
+                defer_storage<tags::pallet_handled>(node, get<2>(current_state), false);
                 node.storage(tags::wearable_sim_op{}) = make_tuple(WEARABLE_IDLE, NO_GOODS, 0);
                 node.storage(tags::wearable_sim_target_pos{}) = make_vec(0,0,0);
             }
         } else if (get<0>(current_state) == WEARABLE_INSERTED) {
             if (make_vec(0,0,0) == node.storage(tags::wearable_sim_target_pos{})) {
-                int random_x = node.next_int(loading_zone_bound_x_0, loading_zone_bound_x_1);
-                int random_y = node.next_int(loading_zone_bound_y_0, loading_zone_bound_y_1);
+                int random_x = node.next_int(sc.loading_zone_bound_x_0(), sc.loading_zone_bound_x_1());
+                int random_y = node.next_int(sc.loading_zone_bound_y_0(), sc.loading_zone_bound_y_1());
                 node.storage(tags::wearable_sim_target_pos{}) = make_vec(random_x, random_y, 0);
             } else if (distance_from(CALL, node.storage(tags::wearable_sim_target_pos{})) < distance_to_consider_same_space) {
-                goods_counter[get<1>(current_state)] = goods_counter[get<1>(current_state)] + 1;
+                common::lock_guard<true> lock(state.mutex);
+                state.inventory.add(get<1>(current_state), +1);
                 node.storage(tags::wearable_sim_op{}) = make_tuple(WEARABLE_IDLE, NO_GOODS, 0);
                 node.storage(tags::wearable_sim_target_pos{}) = make_vec(0,0,0);
             }
@@ -333,48 +1030,60 @@ FUN_EXPORT update_simulation_pre_program_t = export_list<nearest_pallet_device_t
 
 //! @brief Simulation logic to be run after the main warehouse app.
 FUN void update_simulation_post_program(ARGS, device_t waypoint) { CODE
-    common::unique_lock<false> lock;
+    auto& state = node.net.simulation();
+    size_t grid_cell_size = state.scenario.grid_cell_size;
+    times_t t = node.current_time();
     if (node.storage(tags::node_type{}) == warehouse_device_type::Wearable) {
         wearable_sim_state_type current_state = node.storage(tags::wearable_sim_op{});
+        // the pallet handled by the wearable and the waypoint device, as last published
+        node_snapshot target = state.snapshots.get(get<2>(current_state));
+        node_snapshot way = state.snapshots.get(waypoint);
         if (get<0>(current_state) == WEARABLE_IDLE) {
             stop_mov(CALL);
         } else if (get<0>(current_state) == WEARABLE_INSERT) {
-            if (get<2>(current_state) != 0 and node.net.node_count(get<2>(current_state))) {
-                follow_target(CALL, node.net.node_at(get<2>(current_state)).position(), forklift_max_speed, real_t(1.0));
+            if (get<2>(current_state) != 0 and target.known) {
+                follow_target(CALL, target.position_at(t), forklift_max_speed, real_t(1.0));
             }
-        } else if (get<0>(current_state) == WEARABLE_INSERTING and node.net.node_count(waypoint)) {
+        } else if (get<0>(current_state) == WEARABLE_INSERTING and way.known) {
             node.storage(tags::pallet_sim_follow{}) = waypoint;
-            vec<dim> target_position = node.net.node_at(waypoint).position();
+            vec<dim> target_position = way.position_at(t);
             vec<dim> waypoint_position = waypoint_target(CALL, target_position);
-            if (distance_from(CALL, target_position) < (distance_to_consider_same_space * 3) and
-                    node.net.node_count(get<2>(current_state))) {
+            if (distance_from(CALL, target_position) < (distance_to_consider_same_space * 3) and target.known) {
                 waypoint = constant(CALL, waypoint);
                 waypoint_position = target_position = constant(CALL, target_position);
-                waypoint_position[0] = (int((waypoint_position[0]/grid_cell_size-1)/5) * 5 + 3.5) * grid_cell_size;
+                waypoint_position[0] = state.layout.vertical_corridor(waypoint_position[0]/grid_cell_size) * grid_cell_size;
                 if (distance_from(CALL, waypoint_position) < distance_to_consider_same_space) {
                     stop_mov(CALL);
-                    auto& pallet_node = node.net.node_at(get<2>(current_state), lock);
-                    if (norm(pallet_node.position() - pallet_node.storage(tags::pallet_sim_follow_pos{})) < distance_to_consider_same_space * 0.1) {
+                    vec<dim> pallet_position = target.position_at(t);
+                    // the slot assigned to the pallet, chosen once per insertion
+                    vec<dim>& slot = node.storage(tags::wearable_sim_target_pos{});
+                    if (slot != make_vec(0,0,0) and norm(pallet_position - slot) < distance_to_consider_same_space * 0.1) {
                         node.storage(tags::wearable_sim_op{}) = make_tuple(WEARABLE_INSERTED, get<1>(current_state), get<2>(current_state));
-                        node.net.node_at(get<2>(current_state), lock).storage(tags::pallet_sim_follow{}) = 0;
-                        node.net.node_at(get<2>(current_state), lock).storage(tags::pallet_handled{}) = false;
-                        pallet_node.storage(tags::pallet_sim_follow_pos{}) = make_vec(0,0,0);
-                    } else if (distance_from(CALL, pallet_node.position()) < distance_to_consider_same_space) {
-                        pallet_node.storage(tags::pallet_sim_follow{}) = 0;
-                        pallet_node.storage(tags::pallet_sim_follow_pos{}) = find_actual_space(CALL, waypoint);
+                        slot = make_vec(0,0,0);
+                        defer_storage<tags::pallet_sim_follow>(node, get<2>(current_state), device_t(0));
+                        defer_storage<tags::pallet_handled>(node, get<2>(current_state), false);
+                        defer_storage<tags::pallet_sim_follow_pos>(node, get<2>(current_state), make_vec(0,0,0));
+                    } else if (slot == make_vec(0,0,0) and distance_from(CALL, pallet_position) < distance_to_consider_same_space) {
+                        slot = find_actual_space(CALL, waypoint);
+                        defer_storage<tags::pallet_sim_follow>(node, get<2>(current_state), device_t(0));
+                        defer_storage<tags::pallet_sim_follow_pos>(node, get<2>(current_state), slot);
                     }
                 } else follow_target(CALL, waypoint_position, forklift_max_speed, real_t(1.0));
             } else {
                 follow_target(CALL, waypoint_position, forklift_max_speed, real_t(1.0));
             }
-        } else if (get<0>(current_state) == WEARABLE_RETRIEVE and node.net.node_count(waypoint)) {
-            vec<dim> const& target_position = node.net.node_at(waypoint).position();
-            if (get<tags::goods_type>(node.net.node_at(waypoint).storage(tags::loaded_goods{})) == get<1>(current_state) and
-                    node.net.node_at(waypoint).storage(tags::pallet_handled{}) == false and
-                    distance_from(CALL, target_position) < distance_to_consider_same_space) {
+        } else if (get<0>(current_state) == WEARABLE_RETRIEVE and way.known) {
+            vec<dim> target_position = way.position_at(t);
+            // with an order, any of its goods is retrieved
+            order_type const& order = node.storage(tags::order{});
+            uint8_t goods = get<1>(current_state);
+            if (distance_from(CALL, target_position) < distance_to_consider_same_space and claim_pallet(node, waypoint, [&](node_snapshot const& pallet){
+                    goods = get<tags::goods_type>(pallet.loaded_goods);
+                    return (order.empty() ? goods == get<1>(current_state) : std::binary_search(order.begin(), order.end(), goods)) and
+                           (pallet.reserved_by == node.uid or t >= pallet.reservation_end);
+                })) {
                 stop_mov(CALL);
-                node.net.node_at(waypoint, lock).storage(tags::pallet_handled{}) = true;
-                node.storage(tags::wearable_sim_op{}) = make_tuple(WEARABLE_RETRIEVING, get<1>(current_state), waypoint);
+                node.storage(tags::wearable_sim_op{}) = make_tuple(WEARABLE_RETRIEVING, goods, waypoint);
             } else {
                 follow_target(CALL, waypoint_target(CALL, target_position), forklift_max_speed, real_t(1.0));
             }
@@ -382,8 +1091,9 @@ FUN void update_simulation_post_program(ARGS, device_t waypoint) { CODE
             follow_target(CALL, waypoint_target(CALL, node.storage(tags::wearable_sim_target_pos{})), forklift_max_speed, real_t(1.0));
         }
     } else {
-        if (node.storage(tags::pallet_sim_follow{}) != 0 and node.net.node_count(node.storage(tags::pallet_sim_follow{}))) {
-            follow_target(CALL, node.net.node_at(node.storage(tags::pallet_sim_follow{})).position(), forklift_max_speed * 2, real_t(1.0));
+        node_snapshot follow = state.snapshots.get(node.storage(tags::pallet_sim_follow{}));
+        if (node.storage(tags::pallet_sim_follow{}) != 0 and follow.known) {
+            follow_target(CALL, follow.position_at(t), forklift_max_speed * 2, real_t(1.0));
         } else if (node.storage(tags::pallet_sim_follow_pos{}) != make_vec(0,0,0)) {
             follow_target(CALL, node.storage(tags::pallet_sim_follow_pos{}), forklift_max_speed, real_t(1.0));
         } else {
@@ -391,27 +1101,201 @@ FUN void update_simulation_post_program(ARGS, device_t waypoint) { CODE
         }
     }
 }
-FUN_EXPORT update_simulation_post_program_t = export_list<constant_t<device_t>, constant_t<vec<dim>>, waypoint_target_t>;
+FUN_EXPORT update_simulation_post_program_t = export_list<constant_t<device_t>, constant_t<vec<dim>>>;
+
+/**
+ * @brief Postpones the next round of quiescent devices, up to a maximum period.
+ *
+ * A device is quiescent if it is not moving, and neither its state nor its neighbours
+ * (with their states) changed since the previous round. The period between rounds doubles
+ * while a device stays quiescent, and is reset to one second on any change.
+ * Idle wearables are never quiescent, since they start new tasks at a per-round rate.
+ */
+FUN void elide_quiescent_rounds(ARGS, times_t max_period) { CODE
+    using namespace tags;
+    auto mix = [](size_t h, size_t v) {
+        return h * 1000003 ^ v;
+    };
+    size_t self_hash = 0;
+    for (size_t i = 0; i < dim; ++i) self_hash = mix(self_hash, std::hash<real_t>{}(node.position()[i]));
+    self_hash = mix(self_hash, get<goods_type>(node.storage(loaded_goods{})));
+    self_hash = mix(self_hash, get<goods_type>(node.storage(loading_goods{})));
+    self_hash = mix(self_hash, get<goods_type>(node.storage(querying{})));
+    self_hash = mix(self_hash, node.storage(pallet_handled{}) + 2 * node.storage(led_on{}));
+    self_hash = mix(self_hash, node.storage(waypoint_uid{}));
+    self_hash = mix(self_hash, node.storage(pallet_sim_follow{}));
+    self_hash = mix(self_hash, get<0>(node.storage(wearable_sim_op{})));
+    self_hash = mix(self_hash, node.storage(new_logs{}).size() + node.storage(new_safety_logs{}).size() + node.storage(coll_logs{}).size() + node.storage(coll_safety_logs{}).size());
+    // order-independent combination of the neighbours with their states
+    size_t nbr_hash = fold_hood(CALL, [&](tuple<device_t, size_t> n, size_t h){
+        return h + mix(get<0>(n), get<1>(n));
+    }, make_tuple(node.nbr_uid(), nbr(CALL, self_hash)), size_t(0));
+    size_t h = mix(self_hash, nbr_hash);
+    bool idle_wearable = node.storage(node_type{}) == warehouse_device_type::Wearable and get<0>(node.storage(wearable_sim_op{})) == WEARABLE_IDLE;
+    bool quiescent = old(CALL, size_t(0), h) == h and norm(node.velocity()) == 0 and norm(node.propulsion()) == 0 and not idle_wearable;
+    times_t period = old(CALL, times_t(1), [&](times_t p){
+        return quiescent ? min(2 * p, max_period) : times_t(1);
+    });
+    if (period > 1) node.next_time(node.current_time() + period);
+}
+FUN_EXPORT elide_quiescent_rounds_t = export_list<size_t, times_t>;
 
 //! @brief Main function.
 MAIN() {
-    setup_nodes_if_first_round_of_simulation(CALL);
+    size_t allocations = allocation::count();
+    // writes by other nodes are applied and published before claims on the node are released
+    node.net.simulation().pending_writes.apply(node);
+    node.net.simulation().snapshots.publish(node);
+    node.net.simulation().pending_writes.release(node.uid);
+    // nodes spawn at the origin and are positioned in their first round: they join the program from
+    // the next one, so that messages exchanged from the origin carry no data aligned with the program
+    if (setup_nodes_if_first_round_of_simulation(CALL)) {
+        update_node_visually_in_simulation(CALL);
+        node.net.simulation().snapshots.publish(node);
+        return;
+    }
     update_simulation_pre_program(CALL);
-    node.storage(tags::waypoint_uid{}) = warehouse_app(CALL, grid_cell_size, comm, 1500, 1.5*forklift_max_speed);
+    scenario_type const& sc = node.net.simulation().scenario;
+    node.storage(tags::waypoint_uid{}) = warehouse_app(CALL, sc.grid_cell_size, sc.comm, 1500, 1.5*forklift_max_speed, sc.redundancy(), one_hop_collisions, sc.congestion_weight, local_space_detection, dist_filter, 2*forklift_max_speed);
     simulation_statistics(CALL);
     update_simulation_post_program(CALL, node.storage(tags::waypoint_uid{}));
     update_node_visually_in_simulation(CALL);
+    if (sc.max_round_period > 1) elide_quiescent_rounds(CALL, sc.max_round_period);
+    node.storage(tags::round_allocations{}) = allocation::count() - allocations;
+    node.net.simulation().snapshots.publish(node);
 }
 //! @brief Export types used by the main function.
 FUN_EXPORT main_t = export_list<
     setup_nodes_if_first_round_of_simulation_t,
     update_simulation_pre_program_t,
     warehouse_app_t,
-    update_simulation_post_program_t
+    update_simulation_post_program_t,
+    elide_quiescent_rounds_t
 >;
 
 } // namespace coordination
 
+//! @brief Namespace for all FCPP components.
+namespace component {
+
+/**
+ * @brief Component holding the global state of a warehouse simulation in its network.
+ *
+ * Every network owns its state, so that runs do not interfere with each other
+ * and several of them can be executed within the same process.
+ */
+template <class... Ts>
+struct warehouse_state {
+    //! @brief The actual component (with F the final composition, and P the parent component).
+    template <typename F, typename P>
+    struct component : public P {
+        DECLARE_COMPONENT(warehouse_state);
+
+        //! @brief The local part of the component.
+        class node : public P::node {
+          public:
+            //! @brief Main constructor.
+            template <typename S, typename T>
+            node(typename F::net& n, common::tagged_tuple<S,T> const& t) : P::node(n,t) {}
+        };
+
+        //! @brief The global part of the component.
+        class net : public P::net {
+          public:
+            //! @brief Constructor from a tagged tuple.
+            template <typename S, typename T>
+            explicit net(common::tagged_tuple<S,T> const& t) : P::net(t), m_state(t) {}
+
+            //! @brief The global state of the simulation.
+            coordination::simulation_state<typename F::node>& simulation() {
+                return m_state;
+            }
+
+          private:
+            //! @brief The global state of the simulation.
+            coordination::simulation_state<typename F::node> m_state;
+        };
+    };
+};
+
+//! @brief Batch simulator holding the warehouse state.
+DECLARE_COMBINE(batch_warehouse_simulator, warehouse_state, simulated_connector, simulated_positioner, timer, scheduler, logger, storage, spawner, identifier, randomizer, calculus);
+
+//! @brief Interactive simulator holding the warehouse state.
+DECLARE_COMBINE(interactive_warehouse_simulator, warehouse_state, displayer, simulated_map, simulated_connector, simulated_positioner, timer, scheduler, logger, storage, spawner, identifier, randomizer, calculus);
+
+} // namespace component
+
+//! @brief Namespace for aggregators.
+namespace aggregator {
+
+/**
+ * @brief Aggregates delay histograms, reporting max, mean and the 50/95/99 percentiles.
+ *
+ * Percentiles are interpolated within buckets, and the max is the upper bound of the last
+ * non-empty bucket. Memory and cost do not depend on the number of delays.
+ */
+template <typename T>
+class delay_stats {
+  public:
+    //! @brief The type of values aggregated.
+    using type = T;
+
+    //! @brief The type of the aggregation result, given the tag of the aggregated values.
+    template <typename U>
+    using result_type = common::tagged_tuple_t<max<U>, times_t, mean<U>, times_t, quantile<U, 50>, times_t, quantile<U, 95>, times_t, quantile<U, 99>, times_t>;
+
+    //! @brief Combines aggregated values.
+    delay_stats& operator+=(delay_stats const& o) {
+        for (size_t i = 0; i < DELAY_HISTOGRAM_BUCKETS; ++i) m_count[i] += o.m_count[i];
+        m_size += o.m_size;
+        m_sum += o.m_sum;
+        return *this;
+    }
+
+    //! @brief Erases a value from the aggregation set.
+    void erase(T const& value) {
+        for (size_t i = 0; i < DELAY_HISTOGRAM_BUCKETS; ++i) m_count[i] -= value.bucket(i);
+        m_size -= value.size();
+        m_sum -= value.sum();
+    }
+
+    //! @brief Inserts a new value to be aggregated.
+    void insert(T const& value) {
+        for (size_t i = 0; i < DELAY_HISTOGRAM_BUCKETS; ++i) m_count[i] += value.bucket(i);
+        m_size += value.size();
+        m_sum += value.sum();
+    }
+
+    //! @brief The results of aggregation.
+    template <typename U>
+    result_type<U> result() const {
+        return {upper(m_size), m_sum * 0.1 / m_size, upper(m_size * 0.50), upper(m_size * 0.95), upper(m_size * 0.99)};
+    }
+
+  private:
+    //! @brief The delay below which `k` delays fall (interpolating within buckets).
+    times_t upper(times_t k) const {
+        constexpr times_t width = 25.6 / DELAY_HISTOGRAM_BUCKETS;
+        if (m_size == 0) return std::numeric_limits<times_t>::quiet_NaN();
+        size_t c = 0, i = 0;
+        while (i < DELAY_HISTOGRAM_BUCKETS and c + m_count[i] < k) c += m_count[i++];
+        if (i == DELAY_HISTOGRAM_BUCKETS) return DELAY_HISTOGRAM_BUCKETS * width;
+        return (i + (k - c) / m_count[i]) * width;
+    }
+
+    //! @brief Number of delays by bucket.
+    std::array<size_t, DELAY_HISTOGRAM_BUCKETS> m_count{};
+
+    //! @brief Number of delays.
+    size_t m_size = 0;
+
+    //! @brief Sum of delays (in tenths of seconds).
+    size_t m_sum = 0;
+};
+
+} // namespace aggregator
+
 //! @brief Namespace for component options.
 namespace option {
 
@@ -424,32 +1308,36 @@ using namespace coordination::tags;
 using round_s = sequence::periodic<
     distribution::interval_n<times_t, 0, 1>,       // uniform time in the [0,1] interval for start
     distribution::weibull_n<times_t, 100, 1, 100>,   // weibull-distributed time for interval (100/100=1 mean, 1/100=0.01 deviation)
-    distribution::constant_n<times_t, end_time+2>  // the constant end_time+2 number for end
+    distribution::constant_i<times_t, end_time>    // the end_time parameter for end
 >;
 //! @brief The sequence of network snapshots (one every simulated second).
-using log_s = sequence::periodic_n<1, 0, 1, end_time>;
-
-//! @brief The distribution of initial node positions (random in a given rectangle).
-using aisle_rectangle_d = distribution::rect_n<1, loading_zone_bound_x_1, loading_zone_bound_y_1, 0, xside, yside, 0>;
-//! @brief The distribution of initial node positions (random in a given rectangle).
-using loading_rectangle_d = distribution::rect_n<1, loading_zone_bound_x_0, loading_zone_bound_y_0, 0, loading_zone_bound_x_1, loading_zone_bound_y_1, 0>;
+using log_s = sequence::periodic<
+    distribution::constant_n<times_t, 0>,
+    distribution::constant_n<times_t, 1>,
+    distribution::constant_i<times_t, end_time>
+>;
 
-//! @brief Declares `num` devices of a given `type` and `x_distr` position.
-template <warehouse_device_type type, intmax_t num, typename x_distr>
+/**
+ * @brief Declares as many devices of a given `type` as the `num` parameter (stored in aisles, or in the loading zone).
+ *
+ * Positions (and log sinks) are set up in the first round, according to the scenario,
+ * and devices take part in the aggregate program from their second round.
+ */
+template <warehouse_device_type type, typename num, bool stored = false>
 DECLARE_OPTIONS(device,
     // the sequence of node creation events on the network (multiple devices all generated at time 0)
-    spawn_schedule<sequence::multiple_n<num, 0>>,
+    spawn_schedule<sequence::multiple<distribution::constant_i<size_t, num>, distribution::constant_n<times_t, 0>>>,
     // the initialisation data of the node
     init<
-        // pallets have 60% communication power, wearable have 100%
+        // pallets have 60% communication power, wearable have 100% (scaled down to the scenario radius)
         connection_data,distribution::constant_n<real_t, type == warehouse_device_type::Wearable ? 100 : 60, 100>,
         // the node type (wearable or pallet)
         node_type,      distribution::constant_n<warehouse_device_type, (intmax_t)type>,
-        // the position distribution
-        x,              x_distr,
-        // non-standard default values
+        // the final simulation time, for the round schedule
+        end_time,       distribution::constant_i<times_t, end_time>,
+        // non-standard default values (stored pallets are filled in the first round)
         querying,       distribution::constant_n<query_type, NO_GOODS>,
-        loaded_goods,   distribution::constant_n<query_type, NO_GOODS>,
+        loaded_goods,   distribution::constant_n<query_type, stored ? UNDEFINED_GOODS : NO_GOODS>,
         loading_goods,  distribution::constant_n<query_type, UNDEFINED_GOODS>
     >
 );
@@ -462,6 +1350,8 @@ using simulation_store_t = tuple_store<
     node_size,              double,
     log_received__perc,     double,
     log_redundant__perc,    double,
+    safety_received__perc,  double,
+    round_allocations,      size_t,
     waypoint_uid,           device_t,
     wearable_sim_op,        wearable_sim_state_type,
     wearable_sim_target_pos,vec<dim>,
@@ -474,9 +1364,12 @@ using aggregator_t = aggregators<
     msg_received__perc,     aggregator::mean<double>,
     log_collected,          aggregator::combine<aggregator::max<size_t>, aggregator::sum<size_t>>,
     log_created,            aggregator::combine<aggregator::max<size_t>, aggregator::sum<size_t>>,
-    logging_delay,          aggregator::container<std::vector<times_t>, aggregator::combine<aggregator::max<times_t>, aggregator::mean<times_t>>>,
+    logging_delay,          aggregator::delay_stats<delay_histogram>,
+    safety_delay,           aggregator::delay_stats<delay_histogram>,
     log_redundant__perc,    aggregator::mean<double>,
-    log_received__perc,     aggregator::mean<double>
+    safety_received__perc,  aggregator::mean<double>,
+    log_received__perc,     aggregator::mean<double>,
+    round_allocations,      aggregator::combine<aggregator::max<size_t>, aggregator::mean<double>>
 >;
 
 //! @brief Message size plot.
@@ -484,34 +1377,38 @@ using msg_plot_t = plot::split<plot::time, plot::values<aggregator_t, common::ty
 //! @brief Log plot.
 using log_plot_t = plot::split<plot::time, plot::values<aggregator_t, common::type_sequence<>, log_created, log_collected>>;
 //! @brief Loss percentage plot.
-using loss_plot_t = plot::split<plot::time, plot::values<aggregator_t, common::type_sequence<>, msg_received__perc, log_received__perc, log_redundant__perc>>;
+using loss_plot_t = plot::split<plot::time, plot::values<aggregator_t, common::type_sequence<>, msg_received__perc, log_received__perc, log_redundant__perc, safety_received__perc>>;
 //! @brief Log delay plot.
 using delay_plot_t = plot::split<plot::time, plot::values<aggregator_t, common::type_sequence<>, logging_delay>>;
+//! @brief Safety log delay plot.
+using safety_delay_plot_t = plot::split<plot::time, plot::values<aggregator_t, common::type_sequence<>, safety_delay>>;
+//! @brief Heap allocations per round plot.
+using allocation_plot_t = plot::split<plot::time, plot::values<aggregator_t, common::type_sequence<>, round_allocations>>;
 //! @brief The overall description of plots.
-using plot_t = plot::join<msg_plot_t, log_plot_t, loss_plot_t, delay_plot_t>;
+using plot_t = plot::join<msg_plot_t, log_plot_t, loss_plot_t, delay_plot_t, safety_delay_plot_t, allocation_plot_t>;
 
 //! @brief The general simulation options.
 DECLARE_OPTIONS(list,
     general,
-    parallel<false>,     // no multithreading on node rounds
+    parallel<true>,      // multithreading on node rounds (cross-node writes are deferred, reads go through snapshots)
     synchronised<false>, // optimise for asynchronous networks
     message_size<true>,
     program<coordination::main>,   // program to be run (refers to MAIN above)
     exports<coordination::main_t>, // export type list (types used in messages)
     round_schedule<round_s>, // the sequence generator for round events on nodes
     log_schedule<log_s>,     // the sequence generator for log events on the network
-    device<warehouse_device_type::Pallet,   pallet_node_num,       aisle_rectangle_d>,   // stored pallets in aisles
-    device<warehouse_device_type::Pallet,   empty_pallet_node_num, loading_rectangle_d>, // empty pallets in loading zone
-    device<warehouse_device_type::Wearable, wearable_node_num,     loading_rectangle_d>, // wearable devices (in loading zone)
+    device<warehouse_device_type::Pallet,   pallet_num, true>,     // stored pallets in aisles
+    device<warehouse_device_type::Pallet,   empty_pallet_num>,     // empty pallets in loading zone
+    device<warehouse_device_type::Wearable, wearable_num>,         // wearable devices (in loading zone, some acting as sinks)
     simulation_store_t, // the additional contents of the node storage
     aggregator_t,  // the tags and corresponding aggregators to be logged
     plot_type<plot_t>, // the plot description to be used
     dimension<dim>, // dimensionality of the space
-    connector<connect::radial<80,connect::powered<comm,1,dim>>>, // probabilistic connection within a comm range (50% loss at 80% radius)
+    connector<connect::radial<80,connect::powered<max_comm,1,dim>>>, // probabilistic connection within a comm range (50% loss at 80% radius)
     shape_tag<node_shape>, // the shape of a node is read from this tag in the store
     size_tag<node_size>,   // the size of a node is read from this tag in the store
     color_tag<node_color, side_color>,  // colors of a node are read from these
-    area<0,0,xside,yside> // viewport area to be displayed
+    area<0,0,view_xside,view_yside> // viewport area to be displayed (of the reference scenario)
 );
 
 
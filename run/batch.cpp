@@ -3,27 +3,160 @@
 /**
  * @file batch.cpp
  * @brief Runs multiple executions of the warehouse case study non-interactively from the command line, producing overall plots.
+ *
+ * Usage: `batch [workers] [key=value | file]...`, where `workers` is a purely numeric argument.
+ * With more than one worker, the seeds are sharded among as many forked processes, which record the
+ * rows of their plots into `output/batch-shard-<k>.bin`, preceded by their size in bytes. Once every shard
+ * is checked to be complete, the rows are replayed into the overall plots and the shard files removed. The other arguments set the scenario parameters
+ * (see scenario_type), either directly or through configuration files of `key=value` lines.
  */
 
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#ifndef _WIN32
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
 #include "lib/warehouse_simulation.hpp"
 
 using namespace fcpp;
 
+//! @brief Function replaying a serialised plot row into a plotter.
+using replay_type = void(*)(common::isstream&, option::plot_t&);
+
+//! @brief The replay functions, indexed by row type.
+std::vector<replay_type>& replayers() {
+    static std::vector<replay_type> r;
+    return r;
+}
+
+//! @brief Replays rows of a given type (registering itself at static initialisation, before any fork).
+template <typename R>
+struct replayer {
+    //! @brief Reads a row and feeds it to a plotter.
+    static void replay(common::isstream& is, option::plot_t& p) {
+        R row;
+        is >> row;
+        p << row;
+    }
+
+    //! @brief The index of the row type.
+    static const size_t id;
+};
+template <typename R>
+const size_t replayer<R>::id = (replayers().push_back(&replayer<R>::replay), replayers().size() - 1);
+
+//! @brief Plotter recording the rows it receives into a byte stream.
+struct row_recorder {
+    //! @brief Records a row.
+    template <typename R>
+    row_recorder& operator<<(R const& row) {
+        rows << replayer<R>::id << row;
+        return *this;
+    }
+
+    //! @brief The recorded rows.
+    common::osstream rows;
+};
+
+//! @brief The list of initialisation values to be used for the simulations of a scenario with seeds from `first` with a given `step`.
+template <typename P>
+auto make_init_list(coordination::scenario_type const& s, int first, int step, P* p) {
+    return coordination::make_scenario_sequence(s,
+        batch::arithmetic<option::seed>(first, 99, step),           // 100 different random seeds (in total)
+        // generate output file name for the run
+        batch::stringify<option::output>("output/batch", "txt"),
+        batch::constant<option::plotter>(p)                         // reference to the plotter object
+    );
+}
+
 //! @brief The main function.
-int main() {
+int main(int argc, char** argv) {
     //! @brief Construct the plotter object.
     option::plot_t p;
+    //! @brief Number of worker processes (if given as a purely numeric first argument).
+    std::string first = argc > 1 ? argv[1] : "";
+    bool has_workers = not first.empty() and std::all_of(first.begin(), first.end(), [](unsigned char c){ return std::isdigit(c); });
+    int workers = has_workers ? std::max(1, std::atoi(argv[1])) : 1;
+    //! @brief The scenario parameters.
+    coordination::scenario_type scenario;
+    if (not scenario.read(argc, argv, has_workers ? 2 : 1)) {
+        std::cerr << "usage: " << argv[0] << " [workers] [key=value | file]..." << std::endl;
+        return 1;
+    }
+#ifndef _WIN32
+    if (workers > 1) {
+        //! @brief The component type for workers (batch simulator recording plot rows).
+        using worker_t = component::batch_warehouse_simulator<option::plot_type<row_recorder>, option::list>;
+        auto shard_path = [](int k){
+            return "output/batch-shard-" + std::to_string(k) + ".bin";
+        };
+        std::vector<pid_t> pids;
+        for (int k = 0; k < workers; ++k) {
+            pid_t pid = fork();
+            if (pid == 0) {
+                row_recorder r;
+                batch::run(worker_t{}, make_init_list(scenario, k, workers, &r));
+                uint64_t size = r.rows.data().size();
+                std::ofstream f(shard_path(k), std::ios::binary);
+                f.write(reinterpret_cast<char const*>(&size), sizeof(size));
+                f.write(r.rows.data().data(), size);
+                // _exit skips destructors: the stream is flushed and closed explicitly
+                f.close();
+                _exit(f ? 0 : 1);
+            }
+            pids.push_back(pid);
+        }
+        int failed = 0;
+        for (pid_t pid : pids) {
+            int status = 0;
+            waitpid(pid, &status, 0);
+            failed += pid < 0 or not WIFEXITED(status) or WEXITSTATUS(status) != 0;
+        }
+        if (failed > 0) {
+            std::cerr << failed << " worker processes failed" << std::endl;
+            return 1;
+        }
+        // checking that every shard is complete before merging any of them
+        std::vector<std::vector<char>> shards;
+        for (int k = 0; k < workers; ++k) {
+            std::ifstream f(shard_path(k), std::ios::binary);
+            std::vector<char> data(std::istreambuf_iterator<char>(f), {});
+            uint64_t size = 0;
+            if (data.size() >= sizeof(size)) std::memcpy(&size, data.data(), sizeof(size));
+            if (data.size() < sizeof(size) or size != data.size() - sizeof(size)) {
+                std::cerr << "incomplete shard: " << shard_path(k) << std::endl;
+                return 1;
+            }
+            data.erase(data.begin(), data.begin() + sizeof(size));
+            shards.push_back(std::move(data));
+        }
+        // replaying the recorded rows in the shard order
+        for (int k = 0; k < workers; ++k) {
+            common::isstream is(std::move(shards[k]));
+            std::remove(shard_path(k).c_str());
+            while (is.size() > 0) {
+                size_t id;
+                is >> id;
+                replayers()[id](is, p);
+            }
+        }
+        std::cout << plot::file("batch", p.build());
+        return 0;
+    }
+#endif
     //! @brief The component type (batch simulator with given options).
-    using comp_t = component::batch_simulator<option::list>;
-    //! @brief The list of initialisation values to be used for simulations.
-    auto init_list = batch::make_tagged_tuple_sequence(
-        batch::arithmetic<option::seed>(0, 99, 1),                  // 100 different random seeds
-        // generate output file name for the run
-        batch::stringify<option::output>("output/batch", "txt"),
-        batch::constant<option::plotter>(&p)                        // reference to the plotter object
-    );
+    using comp_t = component::batch_warehouse_simulator<option::list>;
     //! @brief Runs the given simulations.
-    batch::run(comp_t{}, init_list);
+    batch::run(comp_t{}, make_init_list(scenario, 0, 1, &p));
     //! @brief Builds the resulting plots.
     std::cout << plot::file("batch", p.build());
     return 0;
@@ -3,6 +3,9 @@
 /**
  * @file graphic.cpp
  * @brief Runs a single execution of the warehouse case study with a graphical user interface.
+ *
+ * Usage: `graphic [key=value | file]...`, where the arguments set the scenario parameters
+ * (see scenario_type), either directly or through configuration files of `key=value` lines.
  */
 
 #include "lib/warehouse_simulation.hpp"
@@ -10,15 +13,22 @@
 using namespace fcpp;
 
 //! @brief The main function.
-int main() {
+int main(int argc, char** argv) {
+    //! @brief The scenario parameters.
+    coordination::scenario_type scenario;
+    if (not scenario.read(argc, argv)) {
+        std::cerr << "usage: " << argv[0] << " [key=value | file]..." << std::endl;
+        return 1;
+    }
     //! @brief Construct the plotter object.
     option::plot_t p;
     std::cout << "/*\n";
     {
         //! @brief The network object type (interactive simulator with given options).
-        using net_t = component::interactive_simulator<option::list>::net;
-        //! @brief The initialisation values (simulation name, texture of the reference plane, node movement speed).
-        auto init_v = common::make_tagged_tuple<option::name, option::texture, option::obstacles, option::plotter>(
+        using net_t = component::interactive_warehouse_simulator<option::list>::net;
+        //! @brief The initialisation values (simulation name, texture of the reference plane, obstacles, plotter and scenario parameters).
+        auto init_v = coordination::make_scenario_tuple<option::name, option::texture, option::obstacles, option::plotter>(
+            scenario,
             "Warehouse Case Study",
             "warehouse.png",
             "warehouse-obstacles.png",